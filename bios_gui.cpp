@@ -13,8 +13,21 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QScrollBar>
+#include <QStatusBar>
+#include <QCheckBox>
+#include <QPainter>
+#include <QPixmap>
+#include <QPaintEvent>
+#include <QFontMetrics>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <queue>
 #include "cpu8085.h"
+#include "blockdevice.h"
+#include "textframebuffer.h"
+#include "sharedstate.h"
+#include "headless.h"
 
 // Interactive terminal widget that handles keyboard input
 class TerminalWidget : public QTextEdit {
@@ -71,37 +84,156 @@ protected:
     }
 };
 
+// Renders a TextFramebuffer at a fixed frame rate. Only rows the guest
+// stored to since the last frame are redrawn into the backing pixmap.
+class TextScreenWidget : public QWidget {
+    Q_OBJECT
+
+private:
+    TextFramebuffer *screen;
+    QPixmap canvas;
+    QFont cellFont;
+    QFont underlineFont;
+    int cellWidth;
+    int cellHeight;
+    int cellAscent;
+
+    static QColor paletteColor(int index) {
+        // CGA palette
+        static const QRgb kPalette[16] = {
+            0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+            0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+        };
+        return QColor(kPalette[index & 0x0F]);
+    }
+
+public:
+    static constexpr int FRAME_INTERVAL_MS = 33;  // ~30 frames per second
+
+    TextScreenWidget(QWidget *parent = nullptr) : QWidget(parent), screen(nullptr) {
+        cellFont = QFont("Monospace", 10);
+        cellFont.setStyleHint(QFont::TypeWriter);
+        cellFont.setFixedPitch(true);
+        underlineFont = cellFont;
+        underlineFont.setUnderline(true);
+
+        QFontMetrics metrics(cellFont);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+        cellWidth = metrics.horizontalAdvance('M');
+#else
+        cellWidth = metrics.width('M');
+#endif
+        cellHeight = metrics.height();
+        cellAscent = metrics.ascent();
+        setAttribute(Qt::WA_OpaquePaintEvent);
+    }
+
+    void setFramebuffer(TextFramebuffer *framebuffer) {
+        screen = framebuffer;
+        if (screen) {
+            const ScreenLayout& layout = screen->getLayout();
+            canvas = QPixmap(layout.columns * cellWidth, layout.rows * cellHeight);
+            canvas.fill(Qt::black);
+            setFixedSize(canvas.size());
+            screen->markAllDirty();
+        }
+        update();
+    }
+
+    // Called once per frame
+    void refresh() {
+        if (!screen || !screen->isDirty()) return;
+        const ScreenLayout& layout = screen->getLayout();
+        QPainter painter(&canvas);
+        for (int row = 0; row < layout.rows; row++) {
+            if (!screen->isRowDirty(row)) continue;
+            drawRow(painter, row);
+            update(0, row * cellHeight, canvas.width(), cellHeight);
+        }
+        screen->clearDirty();
+    }
+
+protected:
+    void paintEvent(QPaintEvent *event) override {
+        QPainter painter(this);
+        if (canvas.isNull()) {
+            painter.fillRect(event->rect(), Qt::black);
+            return;
+        }
+        painter.drawPixmap(event->rect(), canvas, event->rect());
+    }
+
+private:
+    // Cells sharing an attribute are filled and drawn as one run
+    void drawRow(QPainter& painter, int row) {
+        const ScreenLayout& layout = screen->getLayout();
+        int y = row * cellHeight;
+        int column = 0;
+        while (column < layout.columns) {
+            uint8_t attribute = screen->getAttribute(row, column);
+            int start = column;
+            QString text;
+            while (column < layout.columns && screen->getAttribute(row, column) == attribute) {
+                uint8_t ch = screen->getChar(row, column);
+                text += (ch >= 0x20 && ch != 0x7F) ? QChar(ch) : QChar(' ');
+                column++;
+            }
+            QRect rect(start * cellWidth, y, (column - start) * cellWidth, cellHeight);
+            painter.fillRect(rect, paletteColor((attribute >> 4) & 0x07));
+            painter.setFont((attribute & TextFramebuffer::ATTR_UNDERLINE) ? underlineFont : cellFont);
+            painter.setPen(paletteColor(attribute & 0x0F));
+            painter.drawText(rect.x(), y + cellAscent, text);
+        }
+    }
+};
+
 class BIOSEmulatorWindow : public QMainWindow {
     Q_OBJECT
 
 private:
     CPU8085 *cpu;
+    BlockDevice *disk;
+    SharedState *shared;
+    TextFramebuffer *screen;
+    ScreenLayout screenLayout;
     TerminalWidget *terminal;
+    QGroupBox *screenGroup;
+    TextScreenWidget *screenView;
+    QCheckBox *screenCheck;
+    QTimer *frameTimer;
     QTextEdit *registerDisplay;
     QTextEdit *flagsDisplay;
     QTextEdit *memoryDisplay;
+    QLabel *metricsLabel;
     QTimer *runTimer;
     bool running;
 
 public:
-    BIOSEmulatorWindow(QWidget *parent = nullptr) : QMainWindow(parent), running(false) {
+    BIOSEmulatorWindow(QWidget *parent = nullptr) : QMainWindow(parent), screen(nullptr), running(false) {
         setMinimumSize(1200, 800);
         
         cpu = new CPU8085();
+        disk = new BlockDevice(*cpu);
+        shared = new SharedState(*cpu);
         updateWindowTitle();  // Call after CPU is created
         
         // Setup I/O callbacks
         cpu->setIOCallbacks(
-            // IN callback (port 0 = console input)
+            // IN callback (port 0 = console input, block device ports)
             [this](uint8_t port) -> uint8_t {
+                if (disk->handlesPort(port)) {
+                    return disk->readPort(port);
+                }
                 if (port == 0) {
                     return terminal->hasInput() ? terminal->readInput() : 0;
                 }
                 return 0xFF;
             },
-            // OUT callback (port 1 = console output)
+            // OUT callback (port 1 = console output, block device ports)
             [this](uint8_t port, uint8_t value) {
-                if (port == 1) {
+                if (disk->handlesPort(port)) {
+                    disk->writePort(port, value);
+                } else if (port == 1) {
                     terminal->appendOutput(QString(QChar(value)));
                 }
             }
@@ -125,6 +257,15 @@ public:
         terminalGroup->setLayout(terminalLayout);
         leftLayout->addWidget(terminalGroup, 4);
         
+        // Memory-mapped text screen, shown while attached
+        screenGroup = new QGroupBox("Text Screen");
+        QVBoxLayout *screenLayoutBox = new QVBoxLayout();
+        screenView = new TextScreenWidget();
+        screenLayoutBox->addWidget(screenView, 0, Qt::AlignCenter);
+        screenGroup->setLayout(screenLayoutBox);
+        screenGroup->hide();
+        leftLayout->addWidget(screenGroup);
+        
         // Memory viewer
         QGroupBox *memoryGroup = new QGroupBox("Memory Viewer (0x0000-0x00FF)");
         QVBoxLayout *memoryLayout = new QVBoxLayout();
@@ -173,6 +314,10 @@ public:
         QPushButton *runBtn = new QPushButton("Run (F5)");
         QPushButton *stopBtn = new QPushButton("Stop (F6)");
         QPushButton *loadProgBtn = new QPushButton("Load Program...");
+        QPushButton *attachDiskBtn = new QPushButton("Attach Disk...");
+        QCheckBox *jitCheck = new QCheckBox("Block JIT");
+        jitCheck->setChecked(cpu->isJITEnabled());
+        screenCheck = new QCheckBox("Text Screen");
         
         connect(loadBiosBtn, &QPushButton::clicked, this, &BIOSEmulatorWindow::onLoadBIOS);
         connect(resetBtn, &QPushButton::clicked, this, &BIOSEmulatorWindow::onReset);
@@ -180,6 +325,9 @@ public:
         connect(runBtn, &QPushButton::clicked, this, &BIOSEmulatorWindow::onRun);
         connect(stopBtn, &QPushButton::clicked, this, &BIOSEmulatorWindow::onStop);
         connect(loadProgBtn, &QPushButton::clicked, this, &BIOSEmulatorWindow::onLoadProgram);
+        connect(attachDiskBtn, &QPushButton::clicked, this, &BIOSEmulatorWindow::onAttachDisk);
+        connect(jitCheck, &QCheckBox::toggled, this, &BIOSEmulatorWindow::onToggleJIT);
+        connect(screenCheck, &QCheckBox::toggled, this, &BIOSEmulatorWindow::onToggleScreen);
         
         loadBiosBtn->setMinimumHeight(35);
         resetBtn->setMinimumHeight(35);
@@ -187,6 +335,7 @@ public:
         runBtn->setMinimumHeight(35);
         stopBtn->setMinimumHeight(35);
         loadProgBtn->setMinimumHeight(35);
+        attachDiskBtn->setMinimumHeight(35);
         
         controlLayout->addWidget(loadBiosBtn);
         controlLayout->addWidget(resetBtn);
@@ -194,6 +343,9 @@ public:
         controlLayout->addWidget(runBtn);
         controlLayout->addWidget(stopBtn);
         controlLayout->addWidget(loadProgBtn);
+        controlLayout->addWidget(attachDiskBtn);
+        controlLayout->addWidget(jitCheck);
+        controlLayout->addWidget(screenCheck);
         controlLayout->addStretch();
         
         controlGroup->setLayout(controlLayout);
@@ -201,16 +353,46 @@ public:
         
         mainLayout->addLayout(rightLayout, 1);
         
+        // Status bar - runtime metrics
+        metricsLabel = new QLabel();
+        metricsLabel->setFont(QFont("Monospace", 9));
+        statusBar()->addWidget(metricsLabel, 1);
+        
         // Run timer for continuous execution
         runTimer = new QTimer(this);
         connect(runTimer, &QTimer::timeout, this, &BIOSEmulatorWindow::onRunStep);
         
+        // Screen redraws run at their own rate, independent of the run timer
+        frameTimer = new QTimer(this);
+        connect(frameTimer, &QTimer::timeout, screenView, &TextScreenWidget::refresh);
+        
         updateDisplays();
         
         terminal->appendOutput("8085 BIOS System Ready\n");
         terminal->appendOutput("Click 'Load BIOS' to load the monitor ROM\n\n");
     }
 
+    ~BIOSEmulatorWindow() {
+        delete screen;
+        delete shared;  // Moves guest memory back to the heap first
+        delete disk;  // Unmaps and syncs the image
+        delete cpu;
+    }
+
+    // Map the text screen at startup (--screen)
+    void attachScreen(const ScreenLayout& layout) {
+        screenLayout = layout;
+        screenCheck->setChecked(true);
+    }
+
+    // Run guest memory in a shared-memory object for external tools (--shm)
+    bool shareState(const char *name) {
+        if (!shared->open(name)) return false;
+        terminal->appendOutput(QString("Guest state shared at %1\n\n")
+            .arg(QString::fromStdString(shared->getPath())));
+        return true;
+    }
+
     void updateWindowTitle() {
         int bank = cpu ? cpu->getCurrentBank() : 0;
         setWindowTitle(QString("8085 BIOS System - Bank %1/7 (512KB Total)")
@@ -238,6 +420,7 @@ private slots:
         // Reload BIOS if it was loaded
         cpu->loadBinary("build/bios.bin", 0x0000);
         cpu->PC = 0x0000;
+        shared->publish();
         terminal->clear();
         terminal->appendOutput("=== CPU Reset ===\n\n");
         updateDisplays();
@@ -246,6 +429,8 @@ private slots:
     void onStep() {
         if (!cpu->halted) {
             cpu->step();
+            disk->service();
+            shared->publish();
             updateDisplays();
         }
     }
@@ -264,11 +449,13 @@ private slots:
     }
 
     void onRunStep() {
-        if (!cpu->halted) {
+        if (cpu->isRunnable()) {
             // Execute multiple instructions per timer tick for speed
-            for (int i = 0; i < 1000 && !cpu->halted; i++) {
-                cpu->step();
-            }
+            cpu->beginTimedRun();
+            cpu->run(1000);
+            cpu->endTimedRun();
+            disk->service();
+            shared->publish();
             updateDisplays();
             updateWindowTitle();  // Update bank display
         } else {
@@ -293,6 +480,48 @@ private slots:
         }
     }
 
+    void onToggleJIT(bool enabled) {
+        cpu->setJITEnabled(enabled);
+    }
+
+    void onToggleScreen(bool enabled) {
+        if (enabled == (screen != nullptr)) return;
+        if (enabled) {
+            screen = new TextFramebuffer(*cpu, screenLayout);
+            screenView->setFramebuffer(screen);
+            screenGroup->setTitle(QString("Text Screen (%1x%2 at 0x%3)")
+                .arg(screenLayout.columns)
+                .arg(screenLayout.rows)
+                .arg(screenLayout.base, 4, 16, QChar('0')));
+            screenGroup->show();
+            frameTimer->start(TextScreenWidget::FRAME_INTERVAL_MS);
+        } else {
+            frameTimer->stop();
+            screenView->setFramebuffer(nullptr);
+            screenGroup->hide();
+            delete screen;
+            screen = nullptr;
+        }
+    }
+
+    void onAttachDisk() {
+        QString filename = QFileDialog::getOpenFileName(this,
+            "Attach Disk Image", "", "Disk Images (*.img *.dsk);;All Files (*)");
+        
+        if (!filename.isEmpty()) {
+            if (disk->open(filename.toStdString().c_str())) {
+                terminal->appendOutput(QString("\n=== Disk attached: %1 (%2 sectors) ===\n")
+                    .arg(filename)
+                    .arg(disk->getSectorCount()));
+                terminal->appendOutput(QString("Block device on ports 0x%1-0x%2\n\n")
+                    .arg(BlockDevice::BASE_PORT, 2, 16, QChar('0'))
+                    .arg(BlockDevice::BASE_PORT + BlockDevice::NUM_PORTS - 1, 2, 16, QChar('0')));
+            } else {
+                QMessageBox::warning(this, "Error", "Could not open disk image");
+            }
+        }
+    }
+
     void updateDisplays() {
         registerDisplay->setPlainText(QString::fromStdString(cpu->getRegisterState()));
         flagsDisplay->setPlainText(QString::fromStdString(cpu->getFlagsState()));
@@ -308,14 +537,53 @@ private slots:
             memText += "\n";
         }
         memoryDisplay->setPlainText(memText);
+        
+        updateMetricsDisplay();
+    }
+
+    void updateMetricsDisplay() {
+        const CPUMetrics& m = cpu->getMetrics();
+        metricsLabel->setText(QString("Instr: %1 | Cycles: %2 | %3 MHz (%4x) | IN: %5 OUT: %6 | Bank switches: %7 | Idle: %8 s")
+            .arg(m.instructions)
+            .arg(m.cycles)
+            .arg(m.emulatedMHz(), 0, 'f', 2)
+            .arg(m.speedRatio(), 0, 'f', 2)
+            .arg(m.totalPortReads())
+            .arg(m.totalPortWrites())
+            .arg(m.bank_switches)
+            .arg(m.idle_seconds, 0, 'f', 2));
     }
 };
 
 #include "bios_gui.moc"
 
 int main(int argc, char *argv[]) {
+    ScreenLayout screenLayout;
+    bool withScreen = false;
+    const char *shmName = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--headless")) {
+            return runHeadless(argc, argv);
+        }
+        if (!strcmp(argv[i], "--screen") && i + 1 < argc) {
+            if (!parseScreenLayout(argv[++i], screenLayout, CPU8085::NUM_BANKS)) {
+                fprintf(stderr, "Screen must be 'default' or 'COLSxROWS[@BASE[:BANK]]', got %s\n", argv[i]);
+                return 2;
+            }
+            withScreen = true;
+        }
+        if (!strcmp(argv[i], "--shm") && i + 1 < argc) {
+            shmName = argv[++i];
+        }
+    }
+    
     QApplication app(argc, argv);
     BIOSEmulatorWindow window;
+    if (withScreen) window.attachScreen(screenLayout);
+    if (shmName && !window.shareState(shmName)) {
+        fprintf(stderr, "Could not create shared memory %s: %s\n", shmName, strerror(errno));
+        return 1;
+    }
     window.show();
     return app.exec();
 }
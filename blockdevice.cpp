@@ -0,0 +1,163 @@
+#include "blockdevice.h"
+#include "cpu8085.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+BlockDevice::BlockDevice(CPU8085& cpu)
+    : cpu(cpu), fd(-1), image(nullptr), image_size(0), sector_count(0),
+      status(0), sector(0), bank(0), address(0), count(1), mode(0), pending_command(0) {
+}
+
+BlockDevice::~BlockDevice() {
+    close();
+}
+
+bool BlockDevice::open(const char* filename) {
+    close();
+
+    int newFd = ::open(filename, O_RDWR);
+    if (newFd < 0) return false;
+
+    struct stat st;
+    if (fstat(newFd, &st) < 0 || st.st_size < (off_t)SECTOR_SIZE) {
+        ::close(newFd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, newFd, 0);
+    if (mapped == MAP_FAILED) {
+        ::close(newFd);
+        return false;
+    }
+
+    fd = newFd;
+    image = static_cast<uint8_t*>(mapped);
+    image_size = st.st_size;
+    // Sector numbers are 16 bits wide; anything past that is unreachable
+    sector_count = std::min<size_t>(image_size / SECTOR_SIZE, 0x10000);
+    path = filename;
+    status = STATUS_PRESENT;
+    pending_command = 0;
+    return true;
+}
+
+void BlockDevice::close() {
+    if (image) {
+        msync(image, image_size, MS_SYNC);
+        munmap(image, image_size);
+        image = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    image_size = 0;
+    sector_count = 0;
+    status = 0;
+    pending_command = 0;
+    path.clear();
+}
+
+bool BlockDevice::flush() {
+    if (!image) return false;
+    return msync(image, image_size, MS_SYNC) == 0;
+}
+
+uint8_t BlockDevice::readPort(uint8_t port) {
+    switch (port - BASE_PORT) {
+        case 0: return status;
+        case 1: return sector & 0xFF;
+        case 2: return (sector >> 8) & 0xFF;
+        case 3: return bank;
+        case 4: return address & 0xFF;
+        case 5: return (address >> 8) & 0xFF;
+        case 6: return count;
+        case 7: return mode;
+        case 8: return sector_count == 0x10000 ? 0xFF : sector_count & 0xFF;
+        case 9: return sector_count == 0x10000 ? 0xFF : (sector_count >> 8) & 0xFF;
+        default: return 0xFF;
+    }
+}
+
+void BlockDevice::writePort(uint8_t port, uint8_t value) {
+    switch (port - BASE_PORT) {
+        case 0: execute(value); break;
+        case 1: sector = (sector & 0xFF00) | value; break;
+        case 2: sector = (sector & 0x00FF) | (value << 8); break;
+        case 3: bank = value; break;
+        case 4: address = (address & 0xFF00) | value; break;
+        case 5: address = (address & 0x00FF) | (value << 8); break;
+        case 6: count = value; break;
+        case 7: mode = value; break;
+        default: break;  // Capacity registers are read-only
+    }
+}
+
+void BlockDevice::execute(uint8_t command) {
+    if (!image) return;
+
+    if (command == CMD_ACK) {
+        status &= ~(STATUS_DONE | STATUS_ERROR);
+        return;
+    }
+
+    // Commands issued while busy are dropped, like a real controller would
+    if (status & STATUS_BUSY) return;
+
+    status &= ~(STATUS_DONE | STATUS_ERROR);
+    if (command != CMD_READ && command != CMD_WRITE && command != CMD_FLUSH) {
+        status |= STATUS_ERROR;
+        return;
+    }
+
+    if (mode & MODE_ASYNC) {
+        pending_command = command;
+        status |= STATUS_BUSY;
+        return;
+    }
+
+    status |= perform(command) ? STATUS_DONE : STATUS_ERROR;
+}
+
+void BlockDevice::service() {
+    if (!pending_command) return;
+
+    uint8_t command = pending_command;
+    pending_command = 0;
+    bool ok = perform(command);
+    status = (status & ~STATUS_BUSY) | (ok ? STATUS_DONE : STATUS_ERROR);
+
+    if (mode & MODE_IRQ) {
+        cpu.requestInterrupt(IRQ_VECTOR);
+    }
+}
+
+bool BlockDevice::perform(uint8_t command) {
+    switch (command) {
+        case CMD_READ:  return transfer(true);
+        case CMD_WRITE: return transfer(false);
+        case CMD_FLUSH: return flush();
+        default:        return false;
+    }
+}
+
+bool BlockDevice::transfer(bool toMemory) {
+    if (count == 0 || bank >= CPU8085::NUM_BANKS) return false;
+    if ((uint32_t)sector + count > sector_count) return false;
+
+    // The transfer must fit in the target bank without wrapping
+    size_t length = (size_t)count * SECTOR_SIZE;
+    if (address + length > 0x10000) return false;
+
+    uint8_t* disk = image + (size_t)sector * SECTOR_SIZE;
+    if (toMemory) {
+        cpu.copyIntoBank(bank, address, disk, length);
+    } else {
+        std::memcpy(disk, cpu.memory_banks[bank] + address, length);
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#ifndef BLOCKDEVICE_H
+#define BLOCKDEVICE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "cpu8085fwd.h"
+
+// Sector-addressed block storage backed by an mmap'd disk image.
+//
+// Transfers copy whole sectors directly between the mapped image and a
+// target bank/address, so a guest can page code and data in with a handful
+// of OUT instructions instead of byte-at-a-time I/O.
+//
+// Port map (relative to BASE_PORT):
+//   +0  OUT: command (CMD_*)           IN: status (STATUS_*)
+//   +1  sector number, low byte
+//   +2  sector number, high byte
+//   +3  target bank (0-7)
+//   +4  target address, low byte
+//   +5  target address, high byte
+//   +6  sector count (1-255)
+//   +7  mode (MODE_*)
+//   +8  IN: capacity in sectors, low byte
+//   +9  IN: capacity in sectors, high byte
+//
+// In synchronous mode a command completes before the OUT returns. In
+// asynchronous mode the status reads BUSY until the next service() call,
+// which performs the transfer, sets DONE and, with MODE_IRQ, raises RST 6.5.
+class BlockDevice {
+public:
+    static constexpr uint8_t BASE_PORT = 0x10;
+    static constexpr uint8_t NUM_PORTS = 10;
+    static constexpr size_t SECTOR_SIZE = 256;
+    static constexpr uint16_t IRQ_VECTOR = 0x0034;  // RST 6.5
+
+    enum Command : uint8_t {
+        CMD_READ  = 0x01,   // Disk -> memory
+        CMD_WRITE = 0x02,   // Memory -> disk
+        CMD_FLUSH = 0x03,   // msync the image
+        CMD_ACK   = 0x04    // Clear DONE/ERROR
+    };
+
+    enum Status : uint8_t {
+        STATUS_BUSY    = 0x01,
+        STATUS_DONE    = 0x02,
+        STATUS_ERROR   = 0x04,
+        STATUS_PRESENT = 0x80
+    };
+
+    enum Mode : uint8_t {
+        MODE_ASYNC = 0x01,
+        MODE_IRQ   = 0x02
+    };
+
+    explicit BlockDevice(CPU8085& cpu);
+    ~BlockDevice();
+
+    // Map a disk image read/write. Returns false if it cannot be opened.
+    bool open(const char* filename);
+    void close();
+    bool isOpen() const { return image != nullptr; }
+    const std::string& getPath() const { return path; }
+    uint32_t getSectorCount() const { return sector_count; }
+
+    // msync the whole image to disk
+    bool flush();
+
+    bool handlesPort(uint8_t port) const {
+        return port >= BASE_PORT && port < BASE_PORT + NUM_PORTS;
+    }
+    uint8_t readPort(uint8_t port);
+    void writePort(uint8_t port, uint8_t value);
+
+    // Complete a pending asynchronous command. Call once per run batch.
+    void service();
+
+private:
+    CPU8085& cpu;
+    std::string path;
+    int fd;
+    uint8_t* image;
+    size_t image_size;
+    uint32_t sector_count;
+
+    // Guest-visible registers
+    uint8_t status;
+    uint16_t sector;
+    uint8_t bank;
+    uint16_t address;
+    uint8_t count;
+    uint8_t mode;
+    uint8_t pending_command;
+
+    void execute(uint8_t command);
+    bool perform(uint8_t command);
+    bool transfer(bool toMemory);
+};
+
+#endif // BLOCKDEVICE_H
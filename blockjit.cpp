@@ -0,0 +1,1237 @@
+#include "blockjit.h"
+#include "cpu8085.h"
+#include "nativecode.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+constexpr uint16_t NO_COMPILE = 0xFFFF;           // Entry point that cannot be translated
+constexpr uint8_t SMC_PAGE_LIMIT = 8;             // Invalidations before a page is left to the interpreter
+constexpr size_t INVALID_BLOCK_LIMIT = 4096;      // Flush once this many dead blocks pile up
+constexpr uint64_t MEMORY_CHECK_INTERVAL = 64;    // Verify mode: full memory compare every N checks
+
+// Flag bits used by the liveness pass, same layout as the PSW
+constexpr uint8_t F_S = CPU8085::FLAG_S, F_Z = CPU8085::FLAG_Z, F_AC = CPU8085::FLAG_AC;
+constexpr uint8_t F_P = CPU8085::FLAG_P, F_CY = CPU8085::FLAG_CY;
+constexpr uint8_t F_ALL = CPU8085::FLAG_ALL;
+
+// On the 8080 the undefined opcodes alias JMP, CALL and RET; on the 8085 they are NOPs
+bool isTerminator(uint8_t op, bool i8085) {
+    switch (op & 0xC7) {
+        case 0xC0: case 0xC2: case 0xC4: case 0xC7: return true;  // Rcc, Jcc, Ccc, RST
+        default: break;
+    }
+    if (!i8085 && (op == 0xCB || op == 0xD9 || (op & 0xCF) == 0xCD)) return true;  // *JMP, *RET, *CALL
+    return op == 0xC3 || op == 0xCD || op == 0xC9 || op == 0xE9;  // JMP, CALL, RET, PCHL
+}
+
+// I/O and interrupt-control instructions always run in the interpreter
+bool isInterpreterOnly(uint8_t op) {
+    switch (op) {
+        case 0xDB: case 0xD3:   // IN, OUT
+        case 0x76:              // HLT
+        case 0xFB: case 0xF3:   // EI, DI
+        case 0x20: case 0x30:   // RIM, SIM
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool writesMemory(uint8_t op, bool i8085) {
+    if (!i8085 && (op & 0xCF) == 0xCD) return true;           // *CALL
+    if (op >= 0x70 && op <= 0x77 && op != 0x76) return true;  // MOV M,r
+    if ((op & 0xCF) == 0xC5) return true;                      // PUSH
+    if ((op & 0xC7) == 0xC4 || (op & 0xC7) == 0xC7) return true;  // Ccc, RST
+    switch (op) {
+        case 0x36: case 0x34: case 0x35:                       // MVI M, INR M, DCR M
+        case 0x32: case 0x22: case 0x02: case 0x12:            // STA, SHLD, STAX
+        case 0xE3: case 0xCD:                                  // XTHL, CALL
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Flags each instruction unconditionally overwrites, as the interpreter implements it
+uint8_t flagsWritten(uint8_t op) {
+    if ((op >= 0x80 && op <= 0xBF) || (op & 0xC7) == 0xC6) return F_ALL;  // ALU r/M/imm
+    if (op < 0x40 && (op & 0x06) == 0x04) return F_S | F_Z | F_P;         // INR, DCR
+    if (op == 0x27) return F_S | F_Z | F_P;                                // DAA (CY only ever set)
+    if ((op & 0xCF) == 0x09) return F_CY;                                  // DAD
+    switch (op) {
+        case 0x07: case 0x0F: case 0x17: case 0x1F: case 0x37: case 0x3F:  // Rotates, STC, CMC
+            return F_CY;
+        case 0xF1:                                                          // POP PSW
+            return F_ALL;
+        default:
+            return 0;
+    }
+}
+
+uint8_t conditionFlag(uint8_t cc) {
+    static const uint8_t kFlags[8] = {F_Z, F_Z, F_CY, F_CY, F_P, F_P, F_S, F_S};
+    return kFlags[cc & 7];
+}
+
+uint8_t flagsRead(uint8_t op) {
+    if ((op >= 0x88 && op <= 0x8F) || (op >= 0x98 && op <= 0x9F) || op == 0xCE || op == 0xDE) {
+        return F_CY;                                                       // ADC, SBB, ACI, SBI
+    }
+    switch (op & 0xC7) {
+        case 0xC0: case 0xC2: case 0xC4: return conditionFlag(op >> 3);    // Rcc, Jcc, Ccc
+        default: break;
+    }
+    switch (op) {
+        case 0x27: return F_AC | F_CY;                                     // DAA
+        case 0x17: case 0x1F: case 0x3F: return F_CY;                      // RAL, RAR, CMC
+        case 0xF5: return F_ALL;                                           // PUSH PSW
+        default: return 0;
+    }
+}
+
+} // namespace
+
+template<class Config>
+struct BasicBlockJIT<Config>::Op {
+    using Handler = bool (*)(CPU& cpu, const Op& op, const Block& block);
+
+    Handler fn;
+    uint8_t CPU::* r1;   // Destination register, or high half of a pair
+    uint8_t CPU::* r2;   // Source register, or low half of a pair
+    uint16_t imm;            // Immediate data or address
+    uint16_t pc;             // Address of this instruction
+    uint16_t next;           // Address of the following instruction
+    uint8_t opcode;
+    uint8_t cycles;
+    uint8_t cc;              // Condition code for Jcc/Ccc/Rcc
+    bool flags_dead;         // Flags overwritten before anything reads them
+};
+
+template<class Config>
+struct BasicBlockJIT<Config>::Block {
+    // Returns how many ops ran: all of them, or up to the one whose store
+    // invalidated the block
+    using NativeFn = uint32_t (*)(CPU* cpu);
+
+    struct Link {
+        uint16_t pc;
+        Block* block;
+    };
+
+    int bank;
+    uint16_t start;
+    uint16_t end;            // Address after the last instruction
+    bool valid;
+    bool terminated;         // Last op is a control transfer that sets PC itself
+    std::vector<Op> ops;
+    NativeFn native;         // Null when the ops run on their handlers
+    Link links[2];           // Recently seen successors
+    uint8_t next_link;
+    uint64_t cycles;         // Base T-states of a full pass
+    uint64_t runs;           // Full passes not yet folded into the opcode counters
+};
+
+// Pre-bound instruction handlers. Each returns false when the block must
+// stop early because a store just invalidated it.
+template<class Config>
+struct BasicBlockJIT<Config>::Handlers {
+    using Handler = typename Op::Handler;
+
+    static uint8_t read(CPU& cpu, uint16_t address) {
+        return cpu.memory_banks[cpu.current_bank][address];
+    }
+
+    static uint16_t pair(CPU& cpu, const Op& op) {
+        return (cpu.*op.r1 << 8) | cpu.*op.r2;
+    }
+
+    static void setPair(CPU& cpu, const Op& op, uint16_t value) {
+        cpu.*op.r1 = (value >> 8) & 0xFF;
+        cpu.*op.r2 = value & 0xFF;
+    }
+
+    static bool condition(const CPU& cpu, uint8_t cc) {
+        switch (cc) {
+            case 0: return !cpu.getFlag(CPU::FLAG_Z);
+            case 1: return cpu.getFlag(CPU::FLAG_Z);
+            case 2: return !cpu.getFlag(CPU::FLAG_CY);
+            case 3: return cpu.getFlag(CPU::FLAG_CY);
+            case 4: return !cpu.getFlag(CPU::FLAG_P);
+            case 5: return cpu.getFlag(CPU::FLAG_P);
+            case 6: return !cpu.getFlag(CPU::FLAG_S);
+            default: return cpu.getFlag(CPU::FLAG_S);
+        }
+    }
+
+    // Anything without a specialised handler runs through the interpreter
+    static bool interpret(CPU& cpu, const Op& op, const Block& block) {
+        cpu.PC = op.pc + 1;
+        cpu.executeInstruction(op.opcode);
+        return block.valid;
+    }
+
+    // Data transfer
+    static bool movRR(CPU& cpu, const Op& op, const Block&) { cpu.*op.r1 = cpu.*op.r2; return true; }
+    static bool movRM(CPU& cpu, const Op& op, const Block&) { cpu.*op.r1 = read(cpu, cpu.getHL()); return true; }
+    static bool movMR(CPU& cpu, const Op& op, const Block& block) { cpu.writeByte(cpu.getHL(), cpu.*op.r2); return block.valid; }
+    static bool mviR(CPU& cpu, const Op& op, const Block&) { cpu.*op.r1 = op.imm; return true; }
+    static bool mviM(CPU& cpu, const Op& op, const Block& block) { cpu.writeByte(cpu.getHL(), op.imm); return block.valid; }
+    static bool lxiRP(CPU& cpu, const Op& op, const Block&) { setPair(cpu, op, op.imm); return true; }
+    static bool lxiSP(CPU& cpu, const Op& op, const Block&) { cpu.SP = op.imm; return true; }
+    static bool lda(CPU& cpu, const Op& op, const Block&) { cpu.A = read(cpu, op.imm); return true; }
+    static bool sta(CPU& cpu, const Op& op, const Block& block) { cpu.writeByte(op.imm, cpu.A); return block.valid; }
+    static bool ldax(CPU& cpu, const Op& op, const Block&) { cpu.A = read(cpu, pair(cpu, op)); return true; }
+    static bool stax(CPU& cpu, const Op& op, const Block& block) { cpu.writeByte(pair(cpu, op), cpu.A); return block.valid; }
+
+    static bool lhld(CPU& cpu, const Op& op, const Block&) {
+        cpu.L = read(cpu, op.imm);
+        cpu.H = read(cpu, (uint16_t)(op.imm + 1));
+        return true;
+    }
+
+    static bool shld(CPU& cpu, const Op& op, const Block& block) {
+        cpu.writeByte(op.imm, cpu.L);
+        cpu.writeByte(op.imm + 1, cpu.H);
+        return block.valid;
+    }
+
+    static bool xchg(CPU& cpu, const Op&, const Block&) {
+        std::swap(cpu.D, cpu.H);
+        std::swap(cpu.E, cpu.L);
+        return true;
+    }
+
+    // Arithmetic; the F=false variants are used where the flags are dead
+    static bool inxRP(CPU& cpu, const Op& op, const Block&) { setPair(cpu, op, pair(cpu, op) + 1); return true; }
+    static bool dcxRP(CPU& cpu, const Op& op, const Block&) { setPair(cpu, op, pair(cpu, op) - 1); return true; }
+    static bool inxSP(CPU& cpu, const Op&, const Block&) { cpu.SP++; return true; }
+    static bool dcxSP(CPU& cpu, const Op&, const Block&) { cpu.SP--; return true; }
+
+    template<bool F>
+    static bool inrR(CPU& cpu, const Op& op, const Block&) {
+        uint8_t value = ++(cpu.*op.r1);
+        if (F) cpu.setFlagsSZP(value);
+        return true;
+    }
+
+    template<bool F>
+    static bool dcrR(CPU& cpu, const Op& op, const Block&) {
+        uint8_t value = --(cpu.*op.r1);
+        if (F) cpu.setFlagsSZP(value);
+        return true;
+    }
+
+    template<bool F>
+    static void dad(CPU& cpu, uint16_t value) {
+        uint16_t hl = cpu.getHL();
+        uint16_t result = hl + value;
+        if (F) cpu.setCarry(result < hl);
+        cpu.setHL(result);
+    }
+
+    template<bool F>
+    static bool dadRP(CPU& cpu, const Op& op, const Block&) { dad<F>(cpu, pair(cpu, op)); return true; }
+
+    template<bool F>
+    static bool dadSP(CPU& cpu, const Op&, const Block&) { dad<F>(cpu, cpu.SP); return true; }
+
+    // ALU kinds follow opcode bits 5-3: ADD ADC SUB SBB ANA XRA ORA CMP
+    template<int K, bool F>
+    static void alu(CPU& cpu, uint8_t value) {
+        switch (K) {
+            case 0: cpu.A = F ? cpu.add(value) : (uint8_t)(cpu.A + value); break;
+            case 1: cpu.A = F ? cpu.add(value, true) : (uint8_t)(cpu.A + value + (cpu.getFlag(CPU::FLAG_CY) ? 1 : 0)); break;
+            case 2: cpu.A = F ? cpu.sub(value) : (uint8_t)(cpu.A - value); break;
+            case 3: cpu.A = F ? cpu.sub(value, true) : (uint8_t)(cpu.A - value - (cpu.getFlag(CPU::FLAG_CY) ? 1 : 0)); break;
+            case 4: cpu.A &= value; if (F) cpu.setFlagsLogical(cpu.A); break;
+            case 5: cpu.A ^= value; if (F) cpu.setFlagsLogical(cpu.A); break;
+            case 6: cpu.A |= value; if (F) cpu.setFlagsLogical(cpu.A); break;
+            default: if (F) cpu.sub(value); break;
+        }
+    }
+
+    template<int K, bool F>
+    static bool aluR(CPU& cpu, const Op& op, const Block&) { alu<K, F>(cpu, cpu.*op.r2); return true; }
+
+    template<int K, bool F>
+    static bool aluM(CPU& cpu, const Op&, const Block&) { alu<K, F>(cpu, read(cpu, cpu.getHL())); return true; }
+
+    template<int K, bool F>
+    static bool aluI(CPU& cpu, const Op& op, const Block&) { alu<K, F>(cpu, op.imm); return true; }
+
+    template<bool F, size_t... K>
+    static constexpr std::array<Handler, 8> aluRTable(std::index_sequence<K...>) { return {{ &aluR<K, F>... }}; }
+
+    template<bool F, size_t... K>
+    static constexpr std::array<Handler, 8> aluMTable(std::index_sequence<K...>) { return {{ &aluM<K, F>... }}; }
+
+    template<bool F, size_t... K>
+    static constexpr std::array<Handler, 8> aluITable(std::index_sequence<K...>) { return {{ &aluI<K, F>... }}; }
+
+    // Stack
+    static bool pushRP(CPU& cpu, const Op& op, const Block& block) { cpu.push(pair(cpu, op)); return block.valid; }
+    static bool popRP(CPU& cpu, const Op& op, const Block&) { setPair(cpu, op, cpu.pop()); return true; }
+
+    // Branches - always the last op of a block, so they never stop it early
+    static bool jmp(CPU& cpu, const Op& op, const Block&) { cpu.PC = op.imm; return true; }
+
+    static bool jcc(CPU& cpu, const Op& op, const Block&) {
+        if (condition(cpu, op.cc)) {
+            cpu.PC = op.imm;
+            if (Config::I8085) cpu.metrics.cycles += 3;
+        } else {
+            cpu.PC = op.next;
+        }
+        return true;
+    }
+
+    static bool call(CPU& cpu, const Op& op, const Block&) {
+        cpu.push(op.next);
+        cpu.PC = op.imm;
+        return true;
+    }
+
+    static bool ccc(CPU& cpu, const Op& op, const Block&) {
+        if (condition(cpu, op.cc)) {
+            cpu.push(op.next);
+            cpu.PC = op.imm;
+            cpu.metrics.cycles += Config::I8085 ? 9 : 6;
+        } else {
+            cpu.PC = op.next;
+        }
+        return true;
+    }
+
+    static bool ret(CPU& cpu, const Op&, const Block&) { cpu.PC = cpu.pop(); return true; }
+
+    static bool rcc(CPU& cpu, const Op& op, const Block&) {
+        if (condition(cpu, op.cc)) {
+            cpu.PC = cpu.pop();
+            cpu.metrics.cycles += 6;
+        } else {
+            cpu.PC = op.next;
+        }
+        return true;
+    }
+
+    // Fill in op.fn, plus the flag-free variant (if any) for the liveness pass
+    static Handler decode(Op& op) {
+        using Seq = std::make_index_sequence<8>;
+        static constexpr std::array<Handler, 8> kAluR = aluRTable<true>(Seq());
+        static constexpr std::array<Handler, 8> kAluRLean = aluRTable<false>(Seq());
+        static constexpr std::array<Handler, 8> kAluM = aluMTable<true>(Seq());
+        static constexpr std::array<Handler, 8> kAluMLean = aluMTable<false>(Seq());
+        static constexpr std::array<Handler, 8> kAluI = aluITable<true>(Seq());
+        static constexpr std::array<Handler, 8> kAluILean = aluITable<false>(Seq());
+        static uint8_t CPU::* const kRegs[8] = {
+            &CPU::B, &CPU::C, &CPU::D, &CPU::E,
+            &CPU::H, &CPU::L, nullptr, &CPU::A
+        };
+        static uint8_t CPU::* const kPairHigh[3] = {&CPU::B, &CPU::D, &CPU::H};
+        static uint8_t CPU::* const kPairLow[3] = {&CPU::C, &CPU::E, &CPU::L};
+
+        uint8_t opcode = op.opcode;
+        int dst = (opcode >> 3) & 0x07;
+        int src = opcode & 0x07;
+        int rp = (opcode >> 4) & 0x03;
+        op.fn = &interpret;
+        op.cc = dst;
+        if (rp < 3) {
+            op.r1 = kPairHigh[rp];
+            op.r2 = kPairLow[rp];
+        }
+
+        if (opcode >= 0x40 && opcode <= 0x7F) {
+            if (opcode == 0x76) return nullptr;
+            op.r1 = kRegs[dst];
+            op.r2 = kRegs[src];
+            op.fn = dst == 6 ? &movMR : src == 6 ? &movRM : &movRR;
+            return nullptr;
+        }
+
+        if (opcode >= 0x80 && opcode <= 0xBF) {
+            if (src == 6) {
+                op.fn = kAluM[dst];
+                return kAluMLean[dst];
+            }
+            op.r2 = kRegs[src];
+            op.fn = kAluR[dst];
+            return kAluRLean[dst];
+        }
+
+        if ((opcode & 0xC7) == 0xC6) {
+            op.fn = kAluI[dst];
+            return kAluILean[dst];
+        }
+
+        if (opcode < 0x40) {
+            switch (opcode & 0x07) {
+                case 0x06:  // MVI
+                    op.r1 = kRegs[dst];
+                    op.fn = dst == 6 ? &mviM : &mviR;
+                    return nullptr;
+                case 0x04:  // INR
+                    if (dst == 6) return nullptr;
+                    op.r1 = kRegs[dst];
+                    op.fn = &inrR<true>;
+                    return &inrR<false>;
+                case 0x05:  // DCR
+                    if (dst == 6) return nullptr;
+                    op.r1 = kRegs[dst];
+                    op.fn = &dcrR<true>;
+                    return &dcrR<false>;
+                default:
+                    break;
+            }
+            switch (opcode & 0x0F) {
+                case 0x01: op.fn = rp == 3 ? &lxiSP : &lxiRP; return nullptr;
+                case 0x03: op.fn = rp == 3 ? &inxSP : &inxRP; return nullptr;
+                case 0x0B: op.fn = rp == 3 ? &dcxSP : &dcxRP; return nullptr;
+                case 0x09:
+                    op.fn = rp == 3 ? &dadSP<true> : &dadRP<true>;
+                    return rp == 3 ? &dadSP<false> : &dadRP<false>;
+                default:
+                    break;
+            }
+            switch (opcode) {
+                case 0x02: case 0x12: op.fn = &stax; break;
+                case 0x0A: case 0x1A: op.fn = &ldax; break;
+                case 0x22: op.fn = &shld; break;
+                case 0x2A: op.fn = &lhld; break;
+                case 0x32: op.fn = &sta; break;
+                case 0x3A: op.fn = &lda; break;
+                default: break;
+            }
+            return nullptr;
+        }
+
+        switch (opcode & 0xC7) {
+            case 0xC0: op.fn = &rcc; return nullptr;
+            case 0xC2: op.fn = &jcc; return nullptr;
+            case 0xC4: op.fn = &ccc; return nullptr;
+            default: break;
+        }
+        if (rp < 3 && (opcode & 0x0F) == 0x05) op.fn = &pushRP;
+        if (rp < 3 && (opcode & 0x0F) == 0x01) op.fn = &popRP;
+        switch (opcode) {
+            case 0xC3: op.fn = &jmp; break;
+            case 0xCD: op.fn = &call; break;
+            case 0xC9: op.fn = &ret; break;
+            case 0xEB: op.fn = &xchg; break;
+            default: break;
+        }
+        return nullptr;
+    }
+};
+
+#if defined(__x86_64__)
+// Native translation of one block, emitted as
+//   uint32_t block(CPU* cpu)
+// with the CPU pointer in RBX. Guest registers and flag state stay in the
+// CPU object; each instruction loads what it needs into EAX/ECX/EDX/ESI/EDI
+// and stores its results back, so a call into a handler needs no spilling.
+// The flag state follows the interpreter's lazy scheme exactly.
+template<class Config>
+struct BasicBlockJIT<Config>::Native {
+    using Asm = X64Assembler;
+    using Label = Asm::Label;
+
+    Asm as;
+    const CPU& cpu;
+    const Block& block;
+
+    // Offsets of the CPU fields the generated code touches
+    const int32_t a, h, l, sp, pc, bits, pending, result, aux, bank, banks, pages, cycles;
+
+    Native(const CPU& cpu, const Block& block)
+        : cpu(cpu), block(block),
+          a(offset(&cpu.A)), h(offset(&cpu.H)), l(offset(&cpu.L)),
+          sp(offset(&cpu.SP)), pc(offset(&cpu.PC)),
+          bits(offset(&cpu.flag_bits)), pending(offset(&cpu.flag_pending)),
+          result(offset(&cpu.flag_result)), aux(offset(&cpu.flag_aux)),
+          bank(offset(&cpu.current_bank)), banks(offset(&cpu.memory_banks)),
+          pages(offset(&cpu.page_flags)), cycles(offset(&cpu.metrics.cycles)) {
+    }
+
+    int32_t offset(const void* field) const {
+        return static_cast<const char*>(field) - reinterpret_cast<const char*>(&cpu);
+    }
+
+    int32_t reg(uint8_t CPU::* r) const { return offset(&(cpu.*r)); }
+
+    const std::vector<uint8_t>& getCode() const { return as.getCode(); }
+
+    void emit() {
+        as.push(Asm::RBX);
+        as.mov64(Asm::RBX, Asm::RDI);
+        for (size_t i = 0; i < block.ops.size(); i++) {
+            emitOp(block.ops[i], i + 1);
+        }
+        leave(block.ops.size());
+    }
+
+    void leave(uint32_t ran) {
+        as.movImm(Asm::RAX, ran);
+        as.pop(Asm::RBX);
+        as.ret();
+    }
+
+    // Run the op's handler, leaving the block if it reports it invalidated
+    void callHandler(const Op& op, uint32_t ran) {
+        as.mov64(Asm::RDI, Asm::RBX);
+        as.movImm64(Asm::RSI, reinterpret_cast<uintptr_t>(&op));
+        as.movImm64(Asm::RDX, reinterpret_cast<uintptr_t>(&block));
+        as.movImm64(Asm::RAX, reinterpret_cast<uintptr_t>(op.fn));
+        as.call(Asm::RAX);
+        as.testByte(Asm::RAX, Asm::RAX);
+        Label next = as.jcc(Asm::NE);
+        leave(ran);
+        as.bind(next);
+    }
+
+    // dst = (high << 8) | low
+    void loadPair(Asm::Reg dst, int32_t high, int32_t low, Asm::Reg scratch) {
+        as.loadByte(dst, high);
+        as.shl(dst, 8);
+        as.loadByte(scratch, low);
+        as.alu(Asm::OR, dst, scratch);
+    }
+
+    // Stores the low 16 bits of src; src is clobbered
+    void storePair(int32_t high, int32_t low, Asm::Reg src) {
+        as.storeByte(low, src);
+        as.shr(src, 8);
+        as.storeByte(high, src);
+    }
+
+    // dst = byte at the guest address in ECX; clobbers EAX
+    void readMemory(Asm::Reg dst) {
+        as.loadDword(Asm::RAX, bank);
+        as.loadPointerIndexed(Asm::RAX, Asm::RAX, banks);
+        as.loadByteAt(dst, Asm::RAX, Asm::RCX);
+    }
+
+    // Store DL at the guest address in ECX. Unwatched pages are written
+    // directly; anything the page watches must see goes through the handler.
+    void writeMemory(const Op& op, uint32_t ran) {
+        as.loadDword(Asm::RAX, bank);
+        as.mov(Asm::RSI, Asm::RAX);
+        as.shl(Asm::RSI, 8);
+        as.mov(Asm::RDI, Asm::RCX);
+        as.shr(Asm::RDI, 8);
+        as.alu(Asm::ADD, Asm::RSI, Asm::RDI);
+        as.loadByteIndexed(Asm::RSI, Asm::RSI, pages);
+        as.testImm(Asm::RSI, 0xFF);
+        Label watched = as.jcc(Asm::NE);
+        as.loadPointerIndexed(Asm::RAX, Asm::RAX, banks);
+        as.storeByteAt(Asm::RAX, Asm::RCX, Asm::RDX);
+        Label done = as.jmp();
+        as.bind(watched);
+        callHandler(op, ran);
+        as.bind(done);
+    }
+
+    // dst = 0 or 1, the current value of one of S, Z, P or CY
+    void loadFlag(Asm::Reg dst, uint8_t flag) {
+        as.loadByte(dst, pending);
+        as.testImm(dst, flag);
+        Label settled = as.jcc(Asm::E);
+        if (flag == F_CY) {
+            as.loadWord(dst, result);
+            as.shr(dst, 8);
+            as.aluImm(Asm::AND, dst, 1);
+        } else if (flag == F_S) {
+            as.loadByte(dst, result);
+            as.shr(dst, 7);
+        } else {
+            as.loadByte(dst, result);
+            as.testByte(dst, dst);
+            as.setcc(flag == F_Z ? Asm::E : Asm::P, dst);
+            as.movzxByte(dst, dst);
+        }
+        Label done = as.jmp();
+        as.bind(settled);
+        as.loadByte(dst, bits);
+        as.testImm(dst, flag);
+        as.setcc(Asm::NE, dst);
+        as.movzxByte(dst, dst);
+        as.bind(done);
+    }
+
+    // Jump to the returned label unless condition cc holds
+    Label unlessCondition(uint8_t cc) {
+        loadFlag(Asm::RAX, conditionFlag(cc));
+        as.testByte(Asm::RAX, Asm::RAX);
+        return as.jcc(cc & 1 ? Asm::E : Asm::NE);
+    }
+
+    // settleFlags(AC | CY), as setFlagsSZP does first; keeps EAX
+    void settleAuxCarry() {
+        as.loadByte(Asm::RCX, pending);
+        as.testImm(Asm::RCX, F_AC | F_CY);
+        Label settled = as.jcc(Asm::E);
+        as.loadWord(Asm::RDX, result);
+        as.loadByte(Asm::RSI, aux);
+        as.alu(Asm::XOR, Asm::RSI, Asm::RDX);
+        as.aluImm(Asm::AND, Asm::RSI, F_AC);
+        as.shr(Asm::RDX, 8);
+        as.aluImm(Asm::AND, Asm::RDX, F_CY);
+        as.alu(Asm::OR, Asm::RSI, Asm::RDX);
+        as.aluImm(Asm::AND, Asm::RCX, F_AC | F_CY);
+        as.alu(Asm::AND, Asm::RSI, Asm::RCX);
+        as.notReg(Asm::RCX);
+        as.loadByte(Asm::RDX, bits);
+        as.alu(Asm::AND, Asm::RDX, Asm::RCX);
+        as.alu(Asm::OR, Asm::RDX, Asm::RSI);
+        as.storeByte(bits, Asm::RDX);
+        as.bind(settled);
+    }
+
+    // ALU kind k (opcode bits 5-3) of A with the operand in ECX
+    void alu(int k, bool flags) {
+        if (k == 7 && !flags) return;
+        as.loadByte(Asm::RAX, a);
+        if (flags && (k <= 3 || k == 7)) {
+            as.mov(Asm::RDX, Asm::RAX);
+            as.alu(Asm::XOR, Asm::RDX, Asm::RCX);
+            as.storeByte(aux, Asm::RDX);
+        }
+        if (k == 1 || k == 3) loadFlag(Asm::RDX, F_CY);
+        switch (k) {
+            case 0: case 1: as.alu(Asm::ADD, Asm::RAX, Asm::RCX); break;
+            case 2: case 3: case 7: as.alu(Asm::SUB, Asm::RAX, Asm::RCX); break;
+            case 4: as.alu(Asm::AND, Asm::RAX, Asm::RCX); break;
+            case 5: as.alu(Asm::XOR, Asm::RAX, Asm::RCX); break;
+            default: as.alu(Asm::OR, Asm::RAX, Asm::RCX); break;
+        }
+        if (k == 1) as.alu(Asm::ADD, Asm::RAX, Asm::RDX);
+        if (k == 3) as.alu(Asm::SUB, Asm::RAX, Asm::RDX);
+        if (k != 7) as.storeByte(a, Asm::RAX);
+        if (!flags) return;
+        // Carry or borrow lands in bit 8 of the 16-bit result
+        as.storeWord(result, Asm::RAX);
+        if (k >= 4 && k <= 6) as.storeByte(aux, Asm::RAX);
+        as.storeByteImm(pending, F_ALL);
+    }
+
+    // PC = pop(); clobbers EAX, ECX, EDX
+    void popPC() {
+        as.loadWord(Asm::RCX, sp);
+        readMemory(Asm::RDX);
+        as.storeByte(pc, Asm::RDX);
+        as.aluImm(Asm::ADD, Asm::RCX, 1);
+        as.aluImm(Asm::AND, Asm::RCX, 0xFFFF);
+        readMemory(Asm::RDX);
+        as.storeByte(pc + 1, Asm::RDX);
+        as.addWordImm(sp, 2);
+    }
+
+    // ran is the count to report if this op stops the block
+    void emitOp(const Op& op, uint32_t ran) {
+        uint8_t opcode = op.opcode;
+        int dst = (opcode >> 3) & 0x07;
+        int src = opcode & 0x07;
+        int rp = (opcode >> 4) & 0x03;
+        bool flags = !op.flags_dead;
+
+        if (opcode >= 0x40 && opcode <= 0x7F && opcode != 0x76) {
+            if (dst == 6) {
+                as.loadByte(Asm::RDX, reg(op.r2));
+                loadPair(Asm::RCX, h, l, Asm::RAX);
+                writeMemory(op, ran);
+            } else if (src == 6) {
+                loadPair(Asm::RCX, h, l, Asm::RAX);
+                readMemory(Asm::RAX);
+                as.storeByte(reg(op.r1), Asm::RAX);
+            } else {
+                as.loadByte(Asm::RAX, reg(op.r2));
+                as.storeByte(reg(op.r1), Asm::RAX);
+            }
+            return;
+        }
+
+        if (opcode >= 0x80 && opcode <= 0xBF) {
+            if (src == 6) {
+                loadPair(Asm::RCX, h, l, Asm::RAX);
+                readMemory(Asm::RCX);
+            } else {
+                as.loadByte(Asm::RCX, reg(op.r2));
+            }
+            alu(dst, flags);
+            return;
+        }
+
+        if ((opcode & 0xC7) == 0xC6) {
+            as.movImm(Asm::RCX, op.imm);
+            alu(dst, flags);
+            return;
+        }
+
+        if (opcode < 0x40) {
+            switch (opcode & 0x07) {
+                case 0x06:  // MVI
+                    if (dst == 6) {
+                        as.movImm(Asm::RDX, op.imm);
+                        loadPair(Asm::RCX, h, l, Asm::RAX);
+                        writeMemory(op, ran);
+                    } else {
+                        as.storeByteImm(reg(op.r1), op.imm);
+                    }
+                    return;
+                case 0x04:  // INR
+                case 0x05:  // DCR
+                    if (dst == 6) break;
+                    as.loadByte(Asm::RAX, reg(op.r1));
+                    as.aluImm((opcode & 0x07) == 0x04 ? Asm::ADD : Asm::SUB, Asm::RAX, 1);
+                    as.storeByte(reg(op.r1), Asm::RAX);
+                    if (flags) {
+                        settleAuxCarry();
+                        as.movzxByte(Asm::RAX, Asm::RAX);
+                        as.storeWord(result, Asm::RAX);
+                        as.storeByteImm(pending, F_S | F_Z | F_P);
+                    }
+                    return;
+                default:
+                    break;
+            }
+            switch (opcode & 0x0F) {
+                case 0x01:  // LXI
+                    if (rp == 3) {
+                        as.storeWordImm(sp, op.imm);
+                    } else {
+                        as.storeByteImm(reg(op.r1), op.imm >> 8);
+                        as.storeByteImm(reg(op.r2), op.imm & 0xFF);
+                    }
+                    return;
+                case 0x03:  // INX
+                case 0x0B:  // DCX
+                    if (rp == 3) {
+                        as.addWordImm(sp, (opcode & 0x0F) == 0x03 ? 1 : -1);
+                    } else {
+                        loadPair(Asm::RAX, reg(op.r1), reg(op.r2), Asm::RCX);
+                        as.aluImm((opcode & 0x0F) == 0x03 ? Asm::ADD : Asm::SUB, Asm::RAX, 1);
+                        storePair(reg(op.r1), reg(op.r2), Asm::RAX);
+                    }
+                    return;
+                case 0x09:  // DAD
+                    loadPair(Asm::RAX, h, l, Asm::RCX);
+                    if (rp == 3) {
+                        as.loadWord(Asm::RCX, sp);
+                    } else {
+                        loadPair(Asm::RCX, reg(op.r1), reg(op.r2), Asm::RDX);
+                    }
+                    as.alu(Asm::ADD, Asm::RAX, Asm::RCX);
+                    as.mov(Asm::RDX, Asm::RAX);
+                    storePair(h, l, Asm::RDX);
+                    if (flags) {
+                        as.shr(Asm::RAX, 16);
+                        as.loadByte(Asm::RCX, bits);
+                        as.aluImm(Asm::AND, Asm::RCX, F_ALL & ~F_CY);
+                        as.alu(Asm::OR, Asm::RCX, Asm::RAX);
+                        as.storeByte(bits, Asm::RCX);
+                        as.andByteImm(pending, (uint8_t)~F_CY);
+                    }
+                    return;
+                default:
+                    break;
+            }
+            switch (opcode) {
+                case 0x02: case 0x12:   // STAX
+                    loadPair(Asm::RCX, reg(op.r1), reg(op.r2), Asm::RAX);
+                    as.loadByte(Asm::RDX, a);
+                    writeMemory(op, ran);
+                    return;
+                case 0x0A: case 0x1A:   // LDAX
+                    loadPair(Asm::RCX, reg(op.r1), reg(op.r2), Asm::RAX);
+                    readMemory(Asm::RAX);
+                    as.storeByte(a, Asm::RAX);
+                    return;
+                case 0x2A:              // LHLD
+                    as.movImm(Asm::RCX, op.imm);
+                    readMemory(Asm::RDX);
+                    as.storeByte(l, Asm::RDX);
+                    as.movImm(Asm::RCX, (uint16_t)(op.imm + 1));
+                    readMemory(Asm::RDX);
+                    as.storeByte(h, Asm::RDX);
+                    return;
+                case 0x32:              // STA
+                    as.movImm(Asm::RCX, op.imm);
+                    as.loadByte(Asm::RDX, a);
+                    writeMemory(op, ran);
+                    return;
+                case 0x3A:              // LDA
+                    as.movImm(Asm::RCX, op.imm);
+                    readMemory(Asm::RDX);
+                    as.storeByte(a, Asm::RDX);
+                    return;
+                default:
+                    break;
+            }
+        }
+
+        if (rp < 3 && (opcode & 0xCF) == 0xC1) {    // POP rp
+            as.loadWord(Asm::RCX, sp);
+            readMemory(Asm::RDX);
+            as.storeByte(reg(op.r2), Asm::RDX);
+            as.aluImm(Asm::ADD, Asm::RCX, 1);
+            as.aluImm(Asm::AND, Asm::RCX, 0xFFFF);
+            readMemory(Asm::RDX);
+            as.storeByte(reg(op.r1), Asm::RDX);
+            as.addWordImm(sp, 2);
+            return;
+        }
+
+        switch (opcode) {
+            case 0xC3:  // JMP
+                as.storeWordImm(pc, op.imm);
+                return;
+            case 0xC9:  // RET
+                popPC();
+                return;
+            case 0xEB:  // XCHG
+                as.loadByte(Asm::RAX, offset(&cpu.D));
+                as.loadByte(Asm::RCX, h);
+                as.storeByte(h, Asm::RAX);
+                as.storeByte(offset(&cpu.D), Asm::RCX);
+                as.loadByte(Asm::RAX, offset(&cpu.E));
+                as.loadByte(Asm::RCX, l);
+                as.storeByte(l, Asm::RAX);
+                as.storeByte(offset(&cpu.E), Asm::RCX);
+                return;
+            default:
+                break;
+        }
+
+        if ((opcode & 0xC7) == 0xC2) {              // Jcc
+            Label notTaken = unlessCondition(op.cc);
+            as.storeWordImm(pc, op.imm);
+            if (Config::I8085) as.addQwordImm(cycles, 3);
+            Label done = as.jmp();
+            as.bind(notTaken);
+            as.storeWordImm(pc, op.next);
+            as.bind(done);
+            return;
+        }
+
+        if ((opcode & 0xC7) == 0xC0) {              // Rcc
+            Label notTaken = unlessCondition(op.cc);
+            popPC();
+            as.addQwordImm(cycles, 6);
+            Label done = as.jmp();
+            as.bind(notTaken);
+            as.storeWordImm(pc, op.next);
+            as.bind(done);
+            return;
+        }
+
+        callHandler(op, ran);
+    }
+};
+#endif
+
+template<class Config>
+BasicBlockJIT<Config>::BasicBlockJIT(CPU& cpu)
+    : cpu(cpu), hot_threshold(DEFAULT_HOT_THRESHOLD),
+      entry_counts(CPU::NUM_BANKS * 65536, 0),
+      block_map(CPU::NUM_BANKS * 65536, nullptr),
+      page_blocks(CPU::NUM_BANKS * 256),
+      page_invalidations(CPU::NUM_BANKS * 256, 0),
+      invalid_blocks(0), arena_full(false), shadow_checks(0), diverged(false) {
+    setNativeEnabled(true);
+}
+
+template<class Config>
+BasicBlockJIT<Config>::~BasicBlockJIT() {
+    foldMetrics();
+    unwatchPages();
+}
+
+template<class Config>
+uint64_t BasicBlockJIT<Config>::run(uint64_t maxSteps) {
+    uint64_t done = 0;
+    Block* previous = nullptr;
+    bool atEntry = true;
+
+    while (done < maxSteps) {
+        if (cpu.halted || (cpu.interruptPending && cpu.interruptEnabled)) {
+            if (!cpu.isRunnable()) break;
+            done += interpret();
+            previous = nullptr;
+            atEntry = true;
+            continue;
+        }
+
+        if (invalid_blocks > INVALID_BLOCK_LIMIT || arena_full) {
+            flush();
+            previous = nullptr;
+        }
+
+        Block* block = lookup(previous);
+        if (!block && atEntry && !diverged) {
+            uint16_t& count = entry_counts[cpu.current_bank * 65536 + cpu.PC];
+            if (count != NO_COMPILE && ++count >= hot_threshold) {
+                block = compile(cpu.current_bank, cpu.PC);
+                if (!block) count = NO_COMPILE;
+            }
+        }
+        // Blocks run to completion, so near the end of the budget the
+        // interpreter takes over rather than run past maxSteps
+        if (block && block->ops.size() > maxSteps - done) block = nullptr;
+
+        if (block) {
+            done += execute(*block);
+            // A divergence flushes every block, including this one
+            previous = blocks.empty() ? nullptr : block;
+            atEntry = true;
+        } else {
+            uint8_t opcode = cpu.memory_banks[cpu.current_bank][cpu.PC];
+            done += interpret();
+            previous = nullptr;
+            atEntry = isTerminator(opcode, Config::I8085) || isInterpreterOnly(opcode);
+        }
+    }
+    return done;
+}
+
+template<class Config>
+typename BasicBlockJIT<Config>::Block* BasicBlockJIT<Config>::lookup(Block* previous) {
+    int bank = cpu.current_bank;
+    uint16_t pc = cpu.PC;
+
+    if (previous) {
+        for (const typename Block::Link& link : previous->links) {
+            if (link.block && link.pc == pc && link.block->valid && link.block->bank == bank) {
+                stats.chained_entries++;
+                return link.block;
+            }
+        }
+    }
+
+    Block* block = block_map[bank * 65536 + pc];
+    if (block && previous && previous->valid) {
+        previous->links[previous->next_link] = {pc, block};
+        previous->next_link ^= 1;
+    }
+    return block;
+}
+
+template<class Config>
+typename BasicBlockJIT<Config>::Block* BasicBlockJIT<Config>::compile(int bank, uint16_t start) {
+    if (page_invalidations[bank * 256 + (start >> 8)] >= SMC_PAGE_LIMIT) return nullptr;
+
+    const uint8_t* memory = cpu.memory_banks[bank];
+    std::unique_ptr<Block> block(new Block());
+    block->bank = bank;
+    block->start = start;
+    block->valid = true;
+    block->terminated = false;
+    block->links[0] = block->links[1] = {0, nullptr};
+    block->next_link = 0;
+    block->cycles = 0;
+    block->runs = 0;
+    block->native = nullptr;
+
+    std::vector<typename Op::Handler> lean;
+    uint32_t pc = start;
+    while (block->ops.size() < MAX_BLOCK_OPS && pc < 0x10000) {
+        uint8_t opcode = memory[pc];
+        uint8_t length = opcodeLength(opcode, Config::I8085);
+        if (pc + length > 0x10000 || isInterpreterOnly(opcode)) break;
+        if (page_invalidations[bank * 256 + ((pc + length - 1) >> 8)] >= SMC_PAGE_LIMIT) break;
+
+        Op op = {};
+        op.opcode = opcode;
+        op.pc = pc;
+        op.next = pc + length;
+        op.cycles = opcodeCycles(opcode, Config::I8085);
+        if (length == 2) op.imm = memory[pc + 1];
+        if (length == 3) op.imm = memory[pc + 1] | (memory[pc + 2] << 8);
+        lean.push_back(Handlers::decode(op));
+        block->ops.push_back(op);
+        block->cycles += op.cycles;
+
+        pc += length;
+        if (isTerminator(opcode, Config::I8085)) {
+            block->terminated = true;
+            break;
+        }
+    }
+    if (block->ops.empty()) return nullptr;
+    block->end = pc & 0xFFFF;
+
+    // Flag liveness, walking backwards from the exit where everything is live.
+    // A store can end the block early, so flags must be complete after one.
+    uint8_t live = F_ALL;
+    for (size_t i = block->ops.size(); i-- > 0;) {
+        Op& op = block->ops[i];
+        if (writesMemory(op.opcode, Config::I8085)) live = F_ALL;
+        uint8_t written = flagsWritten(op.opcode);
+        if (written && !(written & live) && lean[i]) {
+            op.fn = lean[i];
+            op.flags_dead = true;
+            stats.flag_updates_elided++;
+        }
+        live = (live & ~written) | flagsRead(op.opcode);
+    }
+
+    Block* raw = block.get();
+    for (uint32_t page = start >> 8; page <= ((pc - 1) >> 8); page++) {
+        page_blocks[bank * 256 + page].push_back(raw);
+        cpu.page_flags[bank][page] |= CPU::PAGE_CODE;
+    }
+    block_map[bank * 65536 + start] = raw;
+    blocks.push_back(std::move(block));
+    stats.blocks_compiled++;
+    if (arena) compileNative(*raw);
+    return raw;
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::compileNative(Block& block) {
+#if defined(__x86_64__)
+    // Generated code points at the ops, so they must not move from here on
+    Native native(cpu, block);
+    native.emit();
+    const void* code = arena->add(native.getCode());
+    if (!code) {
+        arena_full = true;
+        return;
+    }
+    block.native = reinterpret_cast<typename Block::NativeFn>(const_cast<void*>(code));
+    stats.native_blocks++;
+#else
+    (void)block;
+#endif
+}
+
+template<class Config>
+uint64_t BasicBlockJIT<Config>::execute(Block& block) {
+    const Op* op = block.ops.data();
+    const Op* end = op + block.ops.size();
+
+    stats.blocks_executed++;
+    if (block.native) {
+        uint32_t ran = block.native(&cpu);
+        op = ran == block.ops.size() ? end : op + ran - 1;
+    } else {
+        for (; op != end; ++op) {
+            if (!op->fn(cpu, *op, block)) break;
+        }
+    }
+
+    // Full passes are counted per block and folded into the per-opcode
+    // counters on read; a pass cut short by a store is counted right away.
+    CPUMetrics& metrics = cpu.metrics;
+    uint64_t executed;
+    if (op == end) {
+        executed = block.ops.size();
+        block.runs++;
+        metrics.cycles += block.cycles;
+        if (!block.terminated) cpu.PC = block.end;
+    } else {
+        executed = op - block.ops.data() + 1;
+        for (const Op* ran = block.ops.data(); ran <= op; ++ran) {
+            metrics.opcode_counts[ran->opcode]++;
+            metrics.cycles += ran->cycles;
+        }
+        // Branches set PC themselves; otherwise continue after the store
+        if (op != end - 1 || !block.terminated) cpu.PC = op->next;
+    }
+    metrics.instructions += executed;
+
+    if (shadow) verifyStep(executed, true, block.start);
+    return executed;
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::foldMetrics() {
+    CPUMetrics& metrics = cpu.metrics;
+    for (const std::unique_ptr<Block>& block : blocks) {
+        if (!block->runs) continue;
+        for (const Op& op : block->ops) {
+            metrics.opcode_counts[op.opcode] += block->runs;
+        }
+        block->runs = 0;
+    }
+}
+
+template<class Config>
+uint64_t BasicBlockJIT<Config>::interpret() {
+    uint16_t pc = cpu.PC;
+    cpu.step();
+    if (shadow) verifyStep(1, false, pc);
+    return 1;
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::unwatchPages() {
+    for (int bank = 0; bank < CPU::NUM_BANKS; bank++) {
+        for (int page = 0; page < 256; page++) {
+            cpu.page_flags[bank][page] &= ~CPU::PAGE_CODE;
+        }
+    }
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::flush() {
+    foldMetrics();
+    unwatchPages();
+    for (std::vector<Block*>& list : page_blocks) list.clear();
+    std::fill(block_map.begin(), block_map.end(), nullptr);
+    std::fill(entry_counts.begin(), entry_counts.end(), 0);
+    blocks.clear();
+    invalid_blocks = 0;
+    if (arena) arena->clear();
+    arena_full = false;
+    stats.flushes++;
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::invalidatePage(int bank, uint8_t page) {
+    std::vector<Block*>& list = page_blocks[bank * 256 + page];
+    bool dropped = false;
+    for (Block* block : list) {
+        if (!block->valid) continue;
+        block->valid = false;
+        dropped = true;
+        invalid_blocks++;
+        stats.invalidations++;
+        Block*& slot = block_map[block->bank * 65536 + block->start];
+        if (slot == block) slot = nullptr;
+    }
+    list.clear();
+    cpu.page_flags[bank][page] &= ~CPU::PAGE_CODE;
+
+    if (dropped) {
+        uint8_t& count = page_invalidations[bank * 256 + page];
+        if (count < SMC_PAGE_LIMIT) count++;
+        std::fill_n(entry_counts.begin() + bank * 65536 + page * 256, 256, 0);
+    }
+}
+
+template<class Config>
+bool BasicBlockJIT<Config>::isNativeSupported() {
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::setNativeEnabled(bool enabled) {
+    enabled = enabled && isNativeSupported();
+    if (enabled == isNativeEnabled()) return;
+    if (!blocks.empty()) flush();
+    arena.reset(enabled ? new CodeArena() : nullptr);
+    if (arena && !arena->isAvailable()) arena.reset();
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::setVerify(bool verify) {
+    if (!verify) {
+        shadow.reset();
+        return;
+    }
+
+    // Interpreter-only copy of the current machine state
+    shadow.reset(new CPU());
+    shadow->setJITEnabled(false);
+    for (int bank = 0; bank < CPU::NUM_BANKS; bank++) {
+        std::memcpy(shadow->memory_banks[bank], cpu.memory_banks[bank], 65536);
+    }
+    shadow->A = cpu.A; shadow->B = cpu.B; shadow->C = cpu.C;
+    shadow->D = cpu.D; shadow->E = cpu.E; shadow->H = cpu.H; shadow->L = cpu.L;
+    shadow->SP = cpu.SP;
+    shadow->PC = cpu.PC;
+    shadow->setFlags(cpu.getFlags());
+    shadow->current_bank = cpu.current_bank;
+    shadow->halted = cpu.halted;
+    shadow->interruptEnabled = cpu.interruptEnabled;
+    shadow->interruptPending = cpu.interruptPending;
+    shadow->interruptVector = cpu.interruptVector;
+
+    // IN always runs interpreted on the primary first, leaving the value in A
+    shadow->setIOCallbacks(
+        [this](uint8_t) -> uint8_t { return cpu.A; },
+        [](uint8_t, uint8_t) {}
+    );
+    shadow_checks = 0;
+    diverged = false;
+    divergence.clear();
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::mirrorInterrupt(uint16_t vector) {
+    if (shadow) shadow->requestInterrupt(vector);
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::mirrorMemory(int bank, uint16_t address, size_t size) {
+    if (!shadow || bank < 0 || bank >= CPU::NUM_BANKS) return;
+    size = std::min(size, (size_t)(65536 - address));
+    std::memcpy(shadow->memory_banks[bank] + address, cpu.memory_banks[bank] + address, size);
+}
+
+template<class Config>
+void BasicBlockJIT<Config>::verifyStep(uint64_t steps, bool afterBlock, uint16_t pc) {
+    for (uint64_t i = 0; i < steps; i++) {
+        shadow->step();
+    }
+    if (afterBlock) stats.verified_blocks++;
+
+    const CPU& ref = *shadow;
+    bool match = cpu.A == ref.A && cpu.B == ref.B && cpu.C == ref.C && cpu.D == ref.D &&
+                 cpu.E == ref.E && cpu.H == ref.H && cpu.L == ref.L &&
+                 cpu.SP == ref.SP && cpu.PC == ref.PC &&
+                 cpu.getFlags() == ref.getFlags() &&
+                 cpu.current_bank == ref.current_bank && cpu.halted == ref.halted &&
+                 cpu.interruptEnabled == ref.interruptEnabled;
+
+    int badBank = -1;
+    if (match && ++shadow_checks % MEMORY_CHECK_INTERVAL == 0) {
+        for (int bank = 0; bank < CPU::NUM_BANKS && badBank < 0; bank++) {
+            if (std::memcmp(cpu.memory_banks[bank], ref.memory_banks[bank], 65536) != 0) badBank = bank;
+        }
+    }
+    if (match && badBank < 0) return;
+
+    std::ostringstream oss;
+    oss << std::hex << std::uppercase;
+    oss << "JIT divergence after " << (afterBlock ? "block" : "step") << " at bank " << cpu.current_bank << " PC " << pc << "\n";
+    if (badBank >= 0) oss << "Memory differs in bank " << badBank << "\n";
+    oss << "JIT:         " << cpu.getRegisterState() << " " << cpu.getFlagsState() << "\n"
+        << "Interpreter: " << ref.getRegisterState() << " " << ref.getFlagsState() << "\n";
+    divergence = oss.str();
+    fprintf(stderr, "%s", divergence.c_str());
+
+    // Stop translating and carry on interpreted from the JIT's state
+    diverged = true;
+    shadow.reset();
+    flush();
+}
+
+template<class Config>
+std::string BasicBlockJIT<Config>::getStatsJSON() const {
+    std::ostringstream oss;
+    oss << "{\"blocks_compiled\": " << stats.blocks_compiled
+        << ", \"blocks_executed\": " << stats.blocks_executed
+        << ", \"chained_entries\": " << stats.chained_entries
+        << ", \"invalidations\": " << stats.invalidations
+        << ", \"flushes\": " << stats.flushes
+        << ", \"native_blocks\": " << stats.native_blocks
+        << ", \"flag_updates_elided\": " << stats.flag_updates_elided
+        << ", \"verified_blocks\": " << stats.verified_blocks
+        << ", \"diverged\": " << (diverged ? "true" : "false") << "}";
+    return oss.str();
+}
+
+template class BasicBlockJIT<CPU8085Config>;
+template class BasicBlockJIT<FlatCPU8085Config>;
+template class BasicBlockJIT<CPU8080Config>;
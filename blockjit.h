@@ -0,0 +1,130 @@
+#ifndef BLOCKJIT_H
+#define BLOCKJIT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpu8085fwd.h"
+
+class CodeArena;
+
+// Block translation tier for BasicCPU8085, for any configuration with HOOKS
+// (BlockJIT is the one for CPU8085).
+//
+// Block entry points are profiled per (bank, PC) while the interpreter runs.
+// Once an entry gets hot, the straight-line code from there up to the next
+// control transfer is decoded once into a block of pre-bound handlers, and
+// on x86-64 hosts also compiled to native code, and executed from then on
+// without fetch/decode. Within a block, flag updates are dropped for
+// instructions whose flags are overwritten before anything reads them; all
+// flags are materialized again at the block exit. Blocks remember their
+// successors so hot loops chain from block to block without going back
+// through the lookup table.
+//
+// Native code covers data transfer, ALU, INR/DCR, DAD, JMP/Jcc and
+// RET/Rcc/POP inline, with 8085 registers kept in the CPU object. Guest
+// stores to unwatched pages are inlined too; stores to watched pages and
+// every other instruction call the op's handler from the native code.
+// Without native support (or with it turned off) the handlers run alone.
+//
+// I/O, HLT, EI/DI and RIM/SIM always go through the interpreter. A guest
+// store into a page holding translated code invalidates every block on that
+// page; pages that keep getting invalidated are treated as self-modifying
+// and left to the interpreter.
+template<class Config>
+class BasicBlockJIT {
+public:
+    using CPU = BasicCPU8085<Config>;
+
+    static constexpr uint16_t DEFAULT_HOT_THRESHOLD = 32;
+    static constexpr size_t MAX_BLOCK_OPS = 64;
+
+    struct Stats {
+        uint64_t blocks_compiled = 0;
+        uint64_t native_blocks = 0;     // Also compiled to native code
+        uint64_t blocks_executed = 0;
+        uint64_t chained_entries = 0;   // Entered via a successor link
+        uint64_t invalidations = 0;     // Blocks discarded by stores
+        uint64_t flushes = 0;
+        uint64_t flag_updates_elided = 0;  // Dead flag computations removed at compile time
+        uint64_t verified_blocks = 0;
+    };
+
+    explicit BasicBlockJIT(CPU& cpu);
+    ~BasicBlockJIT();  // Also clears the PAGE_CODE watches its blocks set
+
+    // Same contract as CPU::run(): at most maxSteps instructions
+    uint64_t run(uint64_t maxSteps);
+
+    // Drop every translated block
+    void flush();
+    void invalidatePage(int bank, uint8_t page);
+
+    // Native code generation (x86-64 only); off runs the handlers alone.
+    // Changing it drops every translated block.
+    static bool isNativeSupported();
+    void setNativeEnabled(bool enabled);
+    bool isNativeEnabled() const { return arena != nullptr; }
+
+    void setHotThreshold(uint16_t threshold) { hot_threshold = threshold; }
+    uint16_t getHotThreshold() const { return hot_threshold; }
+
+    // Differential check: mirror execution on an interpreter-only CPU and
+    // compare state after every block. On divergence the JIT stops
+    // translating, the report is kept, and execution continues interpreted.
+    void setVerify(bool verify);
+    bool isVerifying() const { return shadow != nullptr; }
+    bool hasDiverged() const { return diverged; }
+    const std::string& getDivergence() const { return divergence; }
+
+    // Keep the verification shadow in step with things that bypass run()
+    void mirrorInterrupt(uint16_t vector);
+    void mirrorMemory(int bank, uint16_t address, size_t size);
+
+    // Move per-block execution counts into the CPU's opcode counters
+    void foldMetrics();
+
+    const Stats& getStats() const { return stats; }
+    std::string getStatsJSON() const;
+
+private:
+    struct Op;
+    struct Block;
+    struct Handlers;
+    struct Native;
+
+    CPU& cpu;
+    uint16_t hot_threshold;
+    Stats stats;
+
+    // Indexed by bank * 65536 + PC
+    std::vector<uint16_t> entry_counts;
+    std::vector<Block*> block_map;
+
+    // Blocks live until the next flush, so successor links never dangle
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::vector<std::vector<Block*>> page_blocks;   // Indexed by bank * 256 + page
+    std::vector<uint8_t> page_invalidations;
+    size_t invalid_blocks;
+
+    std::unique_ptr<CodeArena> arena;   // Null when blocks run on handlers only
+    bool arena_full;
+
+    std::unique_ptr<CPU> shadow;
+    uint64_t shadow_checks;
+    bool diverged;
+    std::string divergence;
+
+    Block* compile(int bank, uint16_t pc);
+    void compileNative(Block& block);
+    uint64_t execute(Block& block);
+    Block* lookup(Block* previous);
+    uint64_t interpret();
+    void unwatchPages();
+
+    void verifyStep(uint64_t steps, bool afterBlock, uint16_t pc);
+};
+
+#endif // BLOCKJIT_H
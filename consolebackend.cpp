@@ -0,0 +1,324 @@
+#include "consolebackend.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+ConsoleBackend::ConsoleBackend()
+    : is_socket(false), listen_fd(-1), data_fd(-1), slave_fd(-1), epoll_fd(-1), wake_fd(-1),
+      output_pending(0), reader_attached(false), reader_stalled(false), stopping(false),
+      input_pos(0), want_write(false) {
+}
+
+ConsoleBackend::~ConsoleBackend() {
+    close();
+}
+
+bool ConsoleBackend::openPty() {
+    close();
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0) return false;
+    if (grantpt(master) < 0 || unlockpt(master) < 0) {
+        ::close(master);
+        return false;
+    }
+    const char* name = ptsname(master);
+    int slave = name ? ::open(name, O_RDWR | O_NOCTTY) : -1;
+    if (slave < 0) {
+        ::close(master);
+        return false;
+    }
+
+    // Raw mode: the guest does its own echo and line editing
+    struct termios tio;
+    if (tcgetattr(slave, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    path = name;
+    is_socket = false;
+    data_fd = master;
+    slave_fd = slave;
+    return start();
+}
+
+bool ConsoleBackend::listenUnix(const char* socketPath) {
+    close();
+
+    struct sockaddr_un addr;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    unlink(socketPath);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    path = socketPath;
+    is_socket = true;
+    listen_fd = fd;
+    return start();
+}
+
+bool ConsoleBackend::start() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        close();
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    ev.data.fd = is_socket ? listen_fd : data_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev);
+
+    stopping = false;
+    reader_attached = !is_socket;
+    reader_stalled = false;
+    want_write = false;
+    io_thread = std::thread(&ConsoleBackend::ioLoop, this);
+    return true;
+}
+
+void ConsoleBackend::close() {
+    if (io_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        drained.notify_all();
+        wake();
+        io_thread.join();
+    }
+
+    for (int* fd : {&data_fd, &slave_fd, &listen_fd, &epoll_fd, &wake_fd}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    if (is_socket && !path.empty()) unlink(path.c_str());
+    path.clear();
+    is_socket = false;
+
+    input_shared.clear();
+    output_shared.clear();
+    output_pending = 0;
+    input_local.clear();
+    input_pos = 0;
+    output_local.clear();
+    sending.clear();
+}
+
+uint8_t ConsoleBackend::readByte() {
+    if (input_pos == input_local.size()) {
+        // The guest is waiting for input, so whatever it printed should be visible now
+        if (!output_local.empty()) flush();
+
+        input_local.clear();
+        input_pos = 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (input_shared.empty()) return 0;
+        input_local.swap(input_shared);
+    }
+    return input_local[input_pos++];
+}
+
+void ConsoleBackend::writeByte(uint8_t value) {
+    output_local.push_back(value);
+    if (output_local.size() >= BATCH_SIZE) flush();
+}
+
+void ConsoleBackend::flush() {
+    if (output_local.empty() || !isOpen()) return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    output_shared.insert(output_shared.end(), output_local.begin(), output_local.end());
+    output_pending += output_local.size();
+    output_local.clear();
+
+    wake();
+
+    // Backpressure: hold the guest until the reader catches up, but only
+    // while someone is actually reading
+    auto ready = [this] { return stopping || output_pending <= OUTPUT_LIMIT || !reader_attached; };
+    if (reader_attached && !reader_stalled &&
+        !drained.wait_for(lock, std::chrono::milliseconds(STALL_TIMEOUT_MS), ready)) {
+        reader_stalled = true;
+    }
+    if (!stopping && output_pending > OUTPUT_LIMIT) discardBacklog();
+}
+
+// Drop the oldest output not yet handed to the I/O thread until the backlog
+// is back under OUTPUT_LIMIT. Called with mutex held.
+void ConsoleBackend::discardBacklog() {
+    size_t excess = std::min(output_pending - OUTPUT_LIMIT, output_shared.size());
+    output_shared.erase(output_shared.begin(), output_shared.begin() + excess);
+    output_pending -= excess;
+}
+
+void ConsoleBackend::wake() {
+    uint64_t one = 1;
+    ssize_t put = write(wake_fd, &one, sizeof(one));
+    (void)put;  // Fails only if the counter is saturated, which still wakes the thread
+}
+
+void ConsoleBackend::ioLoop() {
+    struct epoll_event events[4];
+
+    for (;;) {
+        int n = epoll_wait(epoll_fd, events, 4, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            uint32_t what = events[i].events;
+
+            if (fd == wake_fd) {
+                uint64_t count;
+                ssize_t got = read(wake_fd, &count, sizeof(count));
+                (void)got;  // Only the wakeup matters, not the count
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (stopping) return;
+                }
+                writeOutput();
+            } else if (fd == listen_fd) {
+                int client = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (client < 0) continue;
+                if (data_fd >= 0) {
+                    ::close(client);  // Already serving someone
+                    continue;
+                }
+                data_fd = client;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    reader_attached = true;
+                    reader_stalled = false;
+                }
+                struct epoll_event ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN;
+                ev.data.fd = data_fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, data_fd, &ev);
+                want_write = false;
+                writeOutput();  // Anything the guest printed before the client arrived
+            } else if (fd == data_fd) {
+                if (what & EPOLLIN) readInput();
+                if (data_fd >= 0 && (what & EPOLLOUT)) writeOutput();
+                if (data_fd >= 0 && is_socket && (what & (EPOLLHUP | EPOLLERR))) dropClient();
+            }
+        }
+    }
+}
+
+void ConsoleBackend::readInput() {
+    uint8_t buffer[BATCH_SIZE];
+    for (;;) {
+        ssize_t got = read(data_fd, buffer, sizeof(buffer));
+        if (got > 0) {
+            translateLineEndings(buffer, got);
+            std::lock_guard<std::mutex> lock(mutex);
+            input_shared.insert(input_shared.end(), buffer, buffer + got);
+            continue;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && errno == EAGAIN) return;
+        // EOF or error: a socket client went away. The PTY never gets here
+        // while slave_fd is held open.
+        if (is_socket) dropClient();
+        return;
+    }
+}
+
+void ConsoleBackend::writeOutput() {
+    if (data_fd < 0) return;
+
+    size_t written = 0;
+    bool lost = false;
+    for (;;) {
+        // Take the next batch only once the last one is out, so output a
+        // stalled reader isn't taking stays where flush() can trim it
+        if (sending.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            sending.swap(output_shared);
+        }
+        if (sending.empty()) break;
+
+        // MSG_NOSIGNAL: a client that hung up is EPIPE, not a SIGPIPE that
+        // kills the emulator
+        ssize_t put = is_socket ? send(data_fd, sending.data(), sending.size(), MSG_NOSIGNAL)
+                                : write(data_fd, sending.data(), sending.size());
+        if (put > 0) {
+            sending.erase(sending.begin(), sending.begin() + put);
+            written += put;
+            continue;
+        }
+        if (put < 0 && errno == EINTR) continue;
+        if (put < 0 && errno == EAGAIN) break;
+        lost = is_socket;
+        break;
+    }
+    if (lost) {
+        dropClient();
+    } else {
+        setWriteInterest(!sending.empty());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        output_pending -= written;
+        if (written) reader_stalled = false;
+    }
+    drained.notify_all();
+}
+
+void ConsoleBackend::dropClient() {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, data_fd, nullptr);
+    ::close(data_fd);
+    data_fd = -1;
+    want_write = false;
+    // Unsent output stays queued for the next client, and the guest no
+    // longer waits for it to drain
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        output_shared.insert(output_shared.begin(), sending.begin(), sending.end());
+        sending.clear();
+        reader_attached = false;
+    }
+    drained.notify_all();
+}
+
+void ConsoleBackend::setWriteInterest(bool enabled) {
+    if (enabled == want_write || data_fd < 0) return;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (enabled) ev.events |= EPOLLOUT;
+    ev.data.fd = data_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, data_fd, &ev);
+    want_write = enabled;
+}
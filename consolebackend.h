@@ -0,0 +1,92 @@
+#ifndef CONSOLEBACKEND_H
+#define CONSOLEBACKEND_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Console device (ports 0/1) exposed over a pseudo-terminal or a Unix-domain
+// socket, so tools like expect or screen can drive the BIOS and shell.
+//
+// The emulation thread only touches local buffers; bytes are handed to an
+// epoll-driven I/O thread in batches, and that thread reads and writes the
+// file descriptor in bulk. When the reader falls behind and more than
+// OUTPUT_LIMIT bytes are queued, flush() blocks the emulation thread until
+// the backlog drains, which throttles guest output to the reader's pace.
+// Nobody reading (no socket client, or a PTY nothing has drained for
+// STALL_TIMEOUT_MS) never blocks the guest: the oldest queued output is
+// dropped instead, so the backlog keeps the last OUTPUT_LIMIT bytes.
+class ConsoleBackend {
+public:
+    static constexpr size_t OUTPUT_LIMIT = 64 * 1024;  // Queued bytes before the guest is throttled
+    static constexpr size_t BATCH_SIZE = 4096;         // Local output buffered before a hand-off
+    static constexpr int STALL_TIMEOUT_MS = 1000;      // Throttled wait before the reader counts as gone
+
+    ConsoleBackend();
+    ~ConsoleBackend();
+
+    // Create a pseudo-terminal; getPath() returns the slave device to attach to
+    bool openPty();
+    // Listen on a Unix-domain socket; one client is served at a time
+    bool listenUnix(const char* path);
+    void close();
+
+    bool isOpen() const { return io_thread.joinable(); }
+    const std::string& getPath() const { return path; }
+
+    // Emulation thread side
+    uint8_t readByte();             // Port 0: next input byte, or 0 if none
+    void writeByte(uint8_t value);  // Port 1
+    void flush();                   // Hand buffered output to the I/O thread
+
+private:
+    std::string path;
+    bool is_socket;
+    int listen_fd;      // Unix socket mode
+    int data_fd;        // PTY master or connected client; owned by the I/O thread once started
+    int slave_fd;       // Held open so the PTY survives clients coming and going
+    int epoll_fd;
+    int wake_fd;        // eventfd used to wake the I/O thread
+    std::thread io_thread;
+
+    // Shared with the I/O thread, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable drained;
+    std::vector<uint8_t> input_shared;
+    std::vector<uint8_t> output_shared;
+    size_t output_pending;  // Bytes queued but not yet written to data_fd
+    bool reader_attached;   // PTY, or a connected socket client
+    bool reader_stalled;    // Throttled wait timed out; cleared once output drains again
+    bool stopping;
+
+    // Emulation thread only
+    std::vector<uint8_t> input_local;
+    size_t input_pos;
+    std::vector<uint8_t> output_local;
+
+    // I/O thread only
+    std::vector<uint8_t> sending;
+    bool want_write;
+
+    bool start();
+    void wake();
+    void ioLoop();
+    void readInput();
+    void writeOutput();
+    void dropClient();
+    void setWriteInterest(bool enabled);
+    void discardBacklog();
+};
+
+// The BIOS expects CR line endings, same as the GUI terminal sends
+inline void translateLineEndings(uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n') data[i] = '\r';
+    }
+}
+
+#endif // CONSOLEBACKEND_H
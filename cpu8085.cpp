@@ -1,32 +1,204 @@
 #include "cpu8085.h"
+#include "blockjit.h"
+#include "taskprofiler.h"
+#include "textframebuffer.h"
 #include <sstream>
 #include <iomanip>
 #include <cstring>
 #include <cstdio>
 #include <algorithm>
 
-CPU8085::CPU8085() {
+namespace {
+
+// 8085 T-states per opcode. Conditional branches hold the not-taken count;
+// step() adds the difference when the branch is taken.
+std::array<uint8_t, 256> buildCycleTable() {
+    std::array<uint8_t, 256> t;
+    t.fill(4);
+    for (int op = 0x40; op <= 0x7F; op++) {
+        if ((op & 0x07) == 0x06 || (op & 0x38) == 0x30) t[op] = 7;  // MOV r,M / MOV M,r
+    }
+    t[0x76] = 5;  // HLT
+    for (int op = 0x80; op <= 0xBF; op++) {
+        if ((op & 0x07) == 0x06) t[op] = 7;  // ALU M
+    }
+    for (int r = 0; r < 8; r++) {
+        t[0x06 | (r << 3)] = 7;  // MVI r
+        t[0x04 | (r << 3)] = 4;  // INR r
+        t[0x05 | (r << 3)] = 4;  // DCR r
+        t[0xC6 | (r << 3)] = 7;  // ALU immediate
+        t[0xC7 | (r << 3)] = 12; // RST n
+        t[0xC2 | (r << 3)] = 7;  // Jcc (not taken)
+        t[0xC4 | (r << 3)] = 9;  // Ccc (not taken)
+        t[0xC0 | (r << 3)] = 6;  // Rcc (not taken)
+    }
+    t[0x36] = 10; t[0x34] = 10; t[0x35] = 10;   // MVI M, INR M, DCR M
+    for (int rp = 0; rp < 4; rp++) {
+        t[0x01 | (rp << 4)] = 10;  // LXI
+        t[0x03 | (rp << 4)] = 6;   // INX
+        t[0x0B | (rp << 4)] = 6;   // DCX
+        t[0x09 | (rp << 4)] = 10;  // DAD
+        t[0xC5 | (rp << 4)] = 12;  // PUSH
+        t[0xC1 | (rp << 4)] = 10;  // POP
+    }
+    t[0x02] = t[0x12] = t[0x0A] = t[0x1A] = 7;  // STAX/LDAX
+    t[0x22] = t[0x2A] = 16;                      // SHLD/LHLD
+    t[0x32] = t[0x3A] = 13;                      // STA/LDA
+    t[0xC3] = 10; t[0xCD] = 18; t[0xC9] = 10;    // JMP, CALL, RET
+    t[0xE9] = 6;  t[0xF9] = 6;  t[0xE3] = 16;    // PCHL, SPHL, XTHL
+    t[0xDB] = 10; t[0xD3] = 10;                  // IN, OUT
+    return t;
+}
+
+// 8080 T-states, same convention. The undefined opcodes run as the
+// instructions they alias.
+std::array<uint8_t, 256> build8080CycleTable() {
+    std::array<uint8_t, 256> t = buildCycleTable();
+    for (int op = 0x40; op <= 0x7F; op++) {
+        if (t[op] == 4) t[op] = 5;  // MOV r,r
+    }
+    t[0x76] = 7;  // HLT
+    for (int r = 0; r < 8; r++) {
+        if (r != 6) t[0x04 | (r << 3)] = t[0x05 | (r << 3)] = 5;  // INR r, DCR r
+        t[0xC7 | (r << 3)] = 11;  // RST n
+        t[0xC2 | (r << 3)] = 10;  // Jcc, taken or not
+        t[0xC4 | (r << 3)] = 11;  // Ccc (not taken)
+        t[0xC0 | (r << 3)] = 5;   // Rcc (not taken)
+    }
+    for (int rp = 0; rp < 4; rp++) {
+        t[0x03 | (rp << 4)] = 5;   // INX
+        t[0x0B | (rp << 4)] = 5;   // DCX
+        t[0xC5 | (rp << 4)] = 11;  // PUSH
+    }
+    t[0xCD] = 17; t[0xE3] = 18;                    // CALL, XTHL
+    t[0xE9] = 5;  t[0xF9] = 5;                     // PCHL, SPHL
+    t[0xCB] = 10; t[0xD9] = 10;                    // *JMP, *RET
+    t[0xDD] = t[0xED] = t[0xFD] = 17;              // *CALL
+    return t;
+}
+
+const std::array<uint8_t, 256> kCycleTable = buildCycleTable();
+const std::array<uint8_t, 256> k8080CycleTable = build8080CycleTable();
+
+} // namespace
+
+uint8_t opcodeCycles(uint8_t opcode, bool i8085) {
+    return (i8085 ? kCycleTable : k8080CycleTable)[opcode];
+}
+
+uint8_t opcodeLength(uint8_t op, bool i8085) {
+    if (!i8085 && (op == 0xCB || (op & 0xCF) == 0xCD)) return 3;      // *JMP, *CALL
+    if ((op & 0xCF) == 0x01) return 3;                                // LXI
+    if (op == 0x22 || op == 0x2A || op == 0x32 || op == 0x3A) return 3; // SHLD, LHLD, STA, LDA
+    if (op == 0xC3 || op == 0xCD) return 3;                           // JMP, CALL
+    if ((op & 0xC7) == 0xC2 || (op & 0xC7) == 0xC4) return 3;         // Jcc, Ccc
+    if (op < 0x40 && (op & 0x07) == 0x06) return 2;                   // MVI
+    if ((op & 0xC7) == 0xC6) return 2;                                // ALU immediate
+    if (op == 0xDB || op == 0xD3) return 2;                           // IN, OUT
+    return 1;
+}
+
+const char* opcodeClassName(OpcodeClass cls) {
+    switch (cls) {
+        case OpcodeClass::DataTransfer: return "data_transfer";
+        case OpcodeClass::Arithmetic:   return "arithmetic";
+        case OpcodeClass::Logical:      return "logical";
+        case OpcodeClass::Branch:       return "branch";
+        case OpcodeClass::Stack:        return "stack";
+        case OpcodeClass::IO:           return "io";
+        case OpcodeClass::Control:      return "control";
+        default:                        return "unknown";
+    }
+}
+
+OpcodeClass classifyOpcode(uint8_t op) {
+    if (op == 0x76) return OpcodeClass::Control;                 // HLT
+    if (op >= 0x40 && op <= 0x7F) return OpcodeClass::DataTransfer;
+    if (op >= 0x80 && op <= 0x9F) return OpcodeClass::Arithmetic;
+    if (op >= 0xA0 && op <= 0xBF) return OpcodeClass::Logical;
+    if (op < 0x40) {
+        switch (op & 0x07) {
+            case 0x01: return (op & 0x08) ? OpcodeClass::Arithmetic     // DAD
+                                          : OpcodeClass::DataTransfer;  // LXI
+            case 0x02: return OpcodeClass::DataTransfer;                // STAX/LDAX/SHLD/LHLD/STA/LDA
+            case 0x03: case 0x04: case 0x05: return OpcodeClass::Arithmetic;
+            case 0x06: return OpcodeClass::DataTransfer;                // MVI
+            case 0x07:
+                if (op == 0x27) return OpcodeClass::Arithmetic;         // DAA
+                return OpcodeClass::Logical;                            // rotates, CMA, CMC, STC
+            default: return OpcodeClass::Control;                       // NOP, RIM, SIM, undefined
+        }
+    }
+    switch (op) {
+        case 0xDB: case 0xD3: return OpcodeClass::IO;
+        case 0xEB: return OpcodeClass::DataTransfer;                    // XCHG
+        case 0xE3: case 0xF9: return OpcodeClass::Stack;                // XTHL, SPHL
+        case 0xE9: case 0xC9: case 0xC3: case 0xCD: return OpcodeClass::Branch;
+        case 0xFB: case 0xF3: return OpcodeClass::Control;              // EI, DI
+        default: break;
+    }
+    if ((op & 0x0F) == 0x01 || (op & 0x0F) == 0x05) return OpcodeClass::Stack;  // POP, PUSH
+    switch (op & 0x07) {
+        case 0x00: case 0x02: case 0x04: case 0x07: return OpcodeClass::Branch;  // Rcc, Jcc, Ccc, RST
+        case 0x06: return op >= 0xE6 ? OpcodeClass::Logical                      // ANI/XRI/ORI/CPI
+                                     : OpcodeClass::Arithmetic;                  // ADI/ACI/SUI/SBI
+        default: return OpcodeClass::Control;                                    // undefined
+    }
+}
+
+uint64_t CPUMetrics::classCount(OpcodeClass cls) const {
+    uint64_t total = 0;
+    for (int op = 0; op < 256; op++) {
+        if (classifyOpcode(op) == cls) total += opcode_counts[op];
+    }
+    return total;
+}
+
+uint64_t CPUMetrics::totalPortReads() const {
+    uint64_t total = 0;
+    for (uint64_t n : port_reads) total += n;
+    return total;
+}
+
+uint64_t CPUMetrics::totalPortWrites() const {
+    uint64_t total = 0;
+    for (uint64_t n : port_writes) total += n;
+    return total;
+}
+
+double CPUMetrics::emulatedMHz() const {
+    if (run_seconds <= 0.0) return 0.0;
+    return cycles / run_seconds / 1e6;
+}
+
+template<class Config>
+BasicCPU8085<Config>::BasicCPU8085() {
     // Allocate memory banks on heap
     for (int i = 0; i < NUM_BANKS; i++) {
-        memory_banks[i] = new uint8_t[65536];
-        std::memset(memory_banks[i], 0, 65536);
+        heap_banks[i] = new uint8_t[65536];
+        std::memset(heap_banks[i], 0, 65536);
+        memory_banks[i] = heap_banks[i];
     }
+    std::memset(page_flags, 0, sizeof(page_flags));
     current_bank = 0;
     reset();
+    setJITEnabled(true);
 }
 
-CPU8085::~CPU8085() {
+template<class Config>
+BasicCPU8085<Config>::~BasicCPU8085() {
     // Free memory banks
     for (int i = 0; i < NUM_BANKS; i++) {
-        delete[] memory_banks[i];
+        delete[] heap_banks[i];
     }
 }
 
-void CPU8085::reset() {
+template<class Config>
+void BasicCPU8085<Config>::reset() {
     A = B = C = D = E = H = L = 0;
     SP = 0xFFFF;
     PC = 0x0000;
-    flags = {false, false, false, false, false};
+    setFlags(0);
     
     // Clear all memory banks
     for (int i = 0; i < NUM_BANKS; i++) {
@@ -36,36 +208,113 @@ void CPU8085::reset() {
     current_bank = 0;
     halted = false;
     interruptEnabled = false;
+    interruptPending = false;
+    interruptVector = 0;
+    resetMetrics();
+    if constexpr (Config::HOOKS) {
+        if (framebuffer) framebuffer->markAllDirty();
+        
+        // Memory was cleared behind the JIT's back; start it over with the
+        // same settings. The old one clears its PAGE_CODE watches as it goes.
+        if (jit) {
+            bool native = jit->isNativeEnabled();
+            uint16_t threshold = jit->getHotThreshold();
+            bool verify = jit->isVerifying();
+            jit.reset(new JIT(*this));
+            jit->setNativeEnabled(native);
+            jit->setHotThreshold(threshold);
+            jit->setVerify(verify);
+        }
+    }
 }
 
-uint8_t CPU8085::fetchByte() {
-    return memory_banks[current_bank][PC++];
+template<class Config>
+uint64_t BasicCPU8085<Config>::run(uint64_t maxSteps) {
+    if constexpr (Config::HOOKS) {
+        if (jit) return jit->run(maxSteps);
+    }
+    
+    uint64_t done = 0;
+    while (done < maxSteps && isRunnable()) {
+        step();
+        done++;
+    }
+    return done;
 }
 
-uint16_t CPU8085::fetchWord() {
+template<class Config>
+uint8_t BasicCPU8085<Config>::fetchByte() {
+    return memory_banks[activeBank()][PC++];
+}
+
+template<class Config>
+uint16_t BasicCPU8085<Config>::fetchWord() {
     uint8_t low = fetchByte();
     uint8_t high = fetchByte();
     return (high << 8) | low;
 }
 
-void CPU8085::step() {
+template<class Config>
+void BasicCPU8085<Config>::requestInterrupt(uint16_t vector) {
+    interruptPending = true;
+    interruptVector = vector;
+    if (jit) jit->mirrorInterrupt(vector);
+}
+
+template<class Config>
+void BasicCPU8085<Config>::step() {
+    if (interruptPending && interruptEnabled) {
+        // Acknowledge like an RST: push PC, jump to the vector, mask further interrupts
+        interruptPending = false;
+        interruptEnabled = false;
+        if (Config::HOOKS && halted) {
+            // The guest was idle waiting for this interrupt
+            std::chrono::duration<double> idle = std::chrono::steady_clock::now() - halt_start;
+            metrics.idle_seconds += idle.count();
+            metrics.idle_wakeups++;
+        }
+        halted = false;
+        push(PC);
+        PC = interruptVector;
+        metrics.cycles += 12;
+        return;
+    }
+    
     if (halted) return;
     
     uint8_t opcode = fetchByte();
     executeInstruction(opcode);
+    
+    metrics.instructions++;
+    if (Config::HOOKS) metrics.opcode_counts[opcode]++;
+    metrics.cycles += (Config::I8085 ? kCycleTable : k8080CycleTable)[opcode];
+    
+    // Taken conditional branches cost extra T-states. Branches leave the
+    // flags alone, so the condition can still be tested here; comparing PC
+    // would miss branches to the next instruction.
+    switch (opcode & 0xC7) {
+        case 0xC2: if (Config::I8085 && conditionMet(opcode >> 3)) metrics.cycles += 3; break; // Jcc
+        case 0xC4: if (conditionMet(opcode >> 3)) metrics.cycles += Config::I8085 ? 9 : 6; break; // Ccc
+        case 0xC0: if (conditionMet(opcode >> 3)) metrics.cycles += 6; break; // Rcc
+        default: break;
+    }
 }
 
-void CPU8085::executeInstruction(uint8_t opcode) {
+template<class Config>
+void BasicCPU8085<Config>::executeInstruction(uint8_t opcode) {
     uint16_t addr, temp16;
     uint8_t temp8;
     
     // Define memory accessor for current bank
-    uint8_t* memory = memory_banks[current_bank];
+    uint8_t* memory = memory_banks[activeBank()];
     
     switch (opcode) {
         // NOP and HLT
         case 0x00: break; // NOP
-        case 0x76: halted = true; break; // HLT
+        case 0x76: // HLT
+            halted = true;
+            if (Config::HOOKS) halt_start = std::chrono::steady_clock::now();
+            break;
         
         // Data Transfer Group - MOV r1, r2 (all 49 combinations)
         case 0x40: B = B; break; case 0x41: B = C; break; case 0x42: B = D; break; case 0x43: B = E; break;
@@ -80,10 +329,10 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         case 0x64: H = H; break; case 0x65: H = L; break; case 0x66: H = memory[getHL()]; break; case 0x67: H = A; break;
         case 0x68: L = B; break; case 0x69: L = C; break; case 0x6A: L = D; break; case 0x6B: L = E; break;
         case 0x6C: L = H; break; case 0x6D: L = L; break; case 0x6E: L = memory[getHL()]; break; case 0x6F: L = A; break;
-        case 0x70: memory[getHL()] = B; break; case 0x71: memory[getHL()] = C; break;
-        case 0x72: memory[getHL()] = D; break; case 0x73: memory[getHL()] = E; break;
-        case 0x74: memory[getHL()] = H; break; case 0x75: memory[getHL()] = L; break;
-        case 0x77: memory[getHL()] = A; break;
+        case 0x70: writeByte(getHL(), B); break; case 0x71: writeByte(getHL(), C); break;
+        case 0x72: writeByte(getHL(), D); break; case 0x73: writeByte(getHL(), E); break;
+        case 0x74: writeByte(getHL(), H); break; case 0x75: writeByte(getHL(), L); break;
+        case 0x77: writeByte(getHL(), A); break;
         case 0x78: A = B; break; case 0x79: A = C; break; case 0x7A: A = D; break; case 0x7B: A = E; break;
         case 0x7C: A = H; break; case 0x7D: A = L; break; case 0x7E: A = memory[getHL()]; break; case 0x7F: A = A; break;
         
@@ -91,7 +340,7 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         case 0x06: B = fetchByte(); break; case 0x0E: C = fetchByte(); break;
         case 0x16: D = fetchByte(); break; case 0x1E: E = fetchByte(); break;
         case 0x26: H = fetchByte(); break; case 0x2E: L = fetchByte(); break;
-        case 0x36: memory[getHL()] = fetchByte(); break; case 0x3E: A = fetchByte(); break;
+        case 0x36: writeByte(getHL(), fetchByte()); break; case 0x3E: A = fetchByte(); break;
         
         // LXI rp, data16
         case 0x01: setBC(fetchWord()); break; // LXI B
@@ -101,17 +350,17 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         
         // LDA/STA addr
         case 0x3A: addr = fetchWord(); A = memory[addr]; break; // LDA
-        case 0x32: addr = fetchWord(); memory[addr] = A; break; // STA
+        case 0x32: addr = fetchWord(); writeByte(addr, A); break; // STA
         
         // LHLD/SHLD addr
-        case 0x2A: addr = fetchWord(); L = memory[addr]; H = memory[addr + 1]; break; // LHLD
-        case 0x22: addr = fetchWord(); memory[addr] = L; memory[addr + 1] = H; break; // SHLD
+        case 0x2A: addr = fetchWord(); L = memory[addr]; H = memory[(uint16_t)(addr + 1)]; break; // LHLD
+        case 0x22: addr = fetchWord(); writeByte(addr, L); writeByte(addr + 1, H); break; // SHLD
         
         // LDAX/STAX
         case 0x0A: A = memory[getBC()]; break; // LDAX B
         case 0x1A: A = memory[getDE()]; break; // LDAX D
-        case 0x02: memory[getBC()] = A; break; // STAX B
-        case 0x12: memory[getDE()] = A; break; // STAX D
+        case 0x02: writeByte(getBC(), A); break; // STAX B
+        case 0x12: writeByte(getDE(), A); break; // STAX D
         
         // XCHG
         case 0xEB: temp8 = D; D = H; H = temp8; temp8 = E; E = L; L = temp8; break;
@@ -141,18 +390,18 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         case 0xDE: A = sub(fetchByte(), true); break; // SBI
         
         // INR (Increment)
-        case 0x04: B++; updateFlags(B); break; case 0x0C: C++; updateFlags(C); break;
-        case 0x14: D++; updateFlags(D); break; case 0x1C: E++; updateFlags(E); break;
-        case 0x24: H++; updateFlags(H); break; case 0x2C: L++; updateFlags(L); break;
-        case 0x34: temp8 = memory[getHL()] + 1; memory[getHL()] = temp8; updateFlags(temp8); break;
-        case 0x3C: A++; updateFlags(A); break;
+        case 0x04: B++; setFlagsSZP(B); break; case 0x0C: C++; setFlagsSZP(C); break;
+        case 0x14: D++; setFlagsSZP(D); break; case 0x1C: E++; setFlagsSZP(E); break;
+        case 0x24: H++; setFlagsSZP(H); break; case 0x2C: L++; setFlagsSZP(L); break;
+        case 0x34: temp8 = memory[getHL()] + 1; writeByte(getHL(), temp8); setFlagsSZP(temp8); break;
+        case 0x3C: A++; setFlagsSZP(A); break;
         
         // DCR (Decrement)
-        case 0x05: B--; updateFlags(B); break; case 0x0D: C--; updateFlags(C); break;
-        case 0x15: D--; updateFlags(D); break; case 0x1D: E--; updateFlags(E); break;
-        case 0x25: H--; updateFlags(H); break; case 0x2D: L--; updateFlags(L); break;
-        case 0x35: temp8 = memory[getHL()] - 1; memory[getHL()] = temp8; updateFlags(temp8); break;
-        case 0x3D: A--; updateFlags(A); break;
+        case 0x05: B--; setFlagsSZP(B); break; case 0x0D: C--; setFlagsSZP(C); break;
+        case 0x15: D--; setFlagsSZP(D); break; case 0x1D: E--; setFlagsSZP(E); break;
+        case 0x25: H--; setFlagsSZP(H); break; case 0x2D: L--; setFlagsSZP(L); break;
+        case 0x35: temp8 = memory[getHL()] - 1; writeByte(getHL(), temp8); setFlagsSZP(temp8); break;
+        case 0x3D: A--; setFlagsSZP(A); break;
         
         // INX (Increment Register Pair)
         case 0x03: setBC(getBC() + 1); break; case 0x13: setDE(getDE() + 1); break;
@@ -163,44 +412,46 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         case 0x2B: setHL(getHL() - 1); break; case 0x3B: SP--; break;
         
         // DAD (Add register pair to HL)
-        case 0x09: temp16 = getHL() + getBC(); flags.CY = (temp16 < getHL()); setHL(temp16); break;
-        case 0x19: temp16 = getHL() + getDE(); flags.CY = (temp16 < getHL()); setHL(temp16); break;
-        case 0x29: temp16 = getHL() + getHL(); flags.CY = (temp16 < getHL()); setHL(temp16); break;
-        case 0x39: temp16 = getHL() + SP; flags.CY = (temp16 < getHL()); setHL(temp16); break;
+        case 0x09: temp16 = getHL() + getBC(); setCarry(temp16 < getHL()); setHL(temp16); break;
+        case 0x19: temp16 = getHL() + getDE(); setCarry(temp16 < getHL()); setHL(temp16); break;
+        case 0x29: temp16 = getHL() + getHL(); setCarry(temp16 < getHL()); setHL(temp16); break;
+        case 0x39: temp16 = getHL() + SP; setCarry(temp16 < getHL()); setHL(temp16); break;
         
         // DAA (Decimal Adjust Accumulator)
         case 0x27: {
             uint8_t correction = 0;
-            if ((A & 0x0F) > 9 || flags.AC) correction += 0x06;
-            if ((A >> 4) > 9 || flags.CY || ((A >> 4) >= 9 && (A & 0x0F) > 9)) {
+            bool carry = getFlag(FLAG_CY);
+            if ((A & 0x0F) > 9 || getFlag(FLAG_AC)) correction += 0x06;
+            if ((A >> 4) > 9 || carry || ((A >> 4) >= 9 && (A & 0x0F) > 9)) {
                 correction += 0x60;
-                flags.CY = true;
+                carry = true;
             }
             A += correction;
-            updateFlags(A);
+            setFlagsSZP(A);
+            setCarry(carry);
             break;
         }
         
         // Logical Group - ANA (AND)
-        case 0xA0: A &= B; updateFlagsLogical(A); break; case 0xA1: A &= C; updateFlagsLogical(A); break;
-        case 0xA2: A &= D; updateFlagsLogical(A); break; case 0xA3: A &= E; updateFlagsLogical(A); break;
-        case 0xA4: A &= H; updateFlagsLogical(A); break; case 0xA5: A &= L; updateFlagsLogical(A); break;
-        case 0xA6: A &= memory[getHL()]; updateFlagsLogical(A); break; case 0xA7: A &= A; updateFlagsLogical(A); break;
-        case 0xE6: A &= fetchByte(); updateFlagsLogical(A); break; // ANI
+        case 0xA0: A &= B; setFlagsLogical(A); break; case 0xA1: A &= C; setFlagsLogical(A); break;
+        case 0xA2: A &= D; setFlagsLogical(A); break; case 0xA3: A &= E; setFlagsLogical(A); break;
+        case 0xA4: A &= H; setFlagsLogical(A); break; case 0xA5: A &= L; setFlagsLogical(A); break;
+        case 0xA6: A &= memory[getHL()]; setFlagsLogical(A); break; case 0xA7: A &= A; setFlagsLogical(A); break;
+        case 0xE6: A &= fetchByte(); setFlagsLogical(A); break; // ANI
         
         // XRA (XOR)
-        case 0xA8: A ^= B; updateFlagsLogical(A); break; case 0xA9: A ^= C; updateFlagsLogical(A); break;
-        case 0xAA: A ^= D; updateFlagsLogical(A); break; case 0xAB: A ^= E; updateFlagsLogical(A); break;
-        case 0xAC: A ^= H; updateFlagsLogical(A); break; case 0xAD: A ^= L; updateFlagsLogical(A); break;
-        case 0xAE: A ^= memory[getHL()]; updateFlagsLogical(A); break; case 0xAF: A ^= A; updateFlagsLogical(A); break;
-        case 0xEE: A ^= fetchByte(); updateFlagsLogical(A); break; // XRI
+        case 0xA8: A ^= B; setFlagsLogical(A); break; case 0xA9: A ^= C; setFlagsLogical(A); break;
+        case 0xAA: A ^= D; setFlagsLogical(A); break; case 0xAB: A ^= E; setFlagsLogical(A); break;
+        case 0xAC: A ^= H; setFlagsLogical(A); break; case 0xAD: A ^= L; setFlagsLogical(A); break;
+        case 0xAE: A ^= memory[getHL()]; setFlagsLogical(A); break; case 0xAF: A ^= A; setFlagsLogical(A); break;
+        case 0xEE: A ^= fetchByte(); setFlagsLogical(A); break; // XRI
         
         // ORA (OR)
-        case 0xB0: A |= B; updateFlagsLogical(A); break; case 0xB1: A |= C; updateFlagsLogical(A); break;
-        case 0xB2: A |= D; updateFlagsLogical(A); break; case 0xB3: A |= E; updateFlagsLogical(A); break;
-        case 0xB4: A |= H; updateFlagsLogical(A); break; case 0xB5: A |= L; updateFlagsLogical(A); break;
-        case 0xB6: A |= memory[getHL()]; updateFlagsLogical(A); break; case 0xB7: A |= A; updateFlagsLogical(A); break;
-        case 0xF6: A |= fetchByte(); updateFlagsLogical(A); break; // ORI
+        case 0xB0: A |= B; setFlagsLogical(A); break; case 0xB1: A |= C; setFlagsLogical(A); break;
+        case 0xB2: A |= D; setFlagsLogical(A); break; case 0xB3: A |= E; setFlagsLogical(A); break;
+        case 0xB4: A |= H; setFlagsLogical(A); break; case 0xB5: A |= L; setFlagsLogical(A); break;
+        case 0xB6: A |= memory[getHL()]; setFlagsLogical(A); break; case 0xB7: A |= A; setFlagsLogical(A); break;
+        case 0xF6: A |= fetchByte(); setFlagsLogical(A); break; // ORI
         
         // CMP (Compare)
         case 0xB8: sub(B); break; case 0xB9: sub(C); break; case 0xBA: sub(D); break; case 0xBB: sub(E); break;
@@ -208,58 +459,58 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         case 0xFE: sub(fetchByte()); break; // CPI
         
         // RLC (Rotate Left)
-        case 0x07: flags.CY = (A & 0x80) != 0; A = (A << 1) | (flags.CY ? 1 : 0); break;
+        case 0x07: setCarry(A & 0x80); A = (A << 1) | (A >> 7); break;
         
         // RRC (Rotate Right)
-        case 0x0F: flags.CY = (A & 0x01) != 0; A = (A >> 1) | (flags.CY ? 0x80 : 0); break;
+        case 0x0F: setCarry(A & 0x01); A = (A >> 1) | (A << 7); break;
         
         // RAL (Rotate Left through Carry)
-        case 0x17: temp8 = flags.CY ? 1 : 0; flags.CY = (A & 0x80) != 0; A = (A << 1) | temp8; break;
+        case 0x17: temp8 = getFlag(FLAG_CY) ? 1 : 0; setCarry(A & 0x80); A = (A << 1) | temp8; break;
         
         // RAR (Rotate Right through Carry)
-        case 0x1F: temp8 = flags.CY ? 0x80 : 0; flags.CY = (A & 0x01) != 0; A = (A >> 1) | temp8; break;
+        case 0x1F: temp8 = getFlag(FLAG_CY) ? 0x80 : 0; setCarry(A & 0x01); A = (A >> 1) | temp8; break;
         
         // CMA (Complement Accumulator)
         case 0x2F: A = ~A; break;
         
         // CMC (Complement Carry)
-        case 0x3F: flags.CY = !flags.CY; break;
+        case 0x3F: setCarry(!getFlag(FLAG_CY)); break;
         
         // STC (Set Carry)
-        case 0x37: flags.CY = true; break;
+        case 0x37: setCarry(true); break;
         
         // Branch Group - JMP
         case 0xC3: PC = fetchWord(); break; // JMP
-        case 0xC2: addr = fetchWord(); if (!flags.Z) PC = addr; break; // JNZ
-        case 0xCA: addr = fetchWord(); if (flags.Z) PC = addr; break;  // JZ
-        case 0xD2: addr = fetchWord(); if (!flags.CY) PC = addr; break; // JNC
-        case 0xDA: addr = fetchWord(); if (flags.CY) PC = addr; break;  // JC
-        case 0xE2: addr = fetchWord(); if (!flags.P) PC = addr; break;  // JPO
-        case 0xEA: addr = fetchWord(); if (flags.P) PC = addr; break;   // JPE
-        case 0xF2: addr = fetchWord(); if (!flags.S) PC = addr; break;  // JP
-        case 0xFA: addr = fetchWord(); if (flags.S) PC = addr; break;   // JM
+        case 0xC2: addr = fetchWord(); if (!getFlag(FLAG_Z)) PC = addr; break; // JNZ
+        case 0xCA: addr = fetchWord(); if (getFlag(FLAG_Z)) PC = addr; break;  // JZ
+        case 0xD2: addr = fetchWord(); if (!getFlag(FLAG_CY)) PC = addr; break; // JNC
+        case 0xDA: addr = fetchWord(); if (getFlag(FLAG_CY)) PC = addr; break;  // JC
+        case 0xE2: addr = fetchWord(); if (!getFlag(FLAG_P)) PC = addr; break;  // JPO
+        case 0xEA: addr = fetchWord(); if (getFlag(FLAG_P)) PC = addr; break;   // JPE
+        case 0xF2: addr = fetchWord(); if (!getFlag(FLAG_S)) PC = addr; break;  // JP
+        case 0xFA: addr = fetchWord(); if (getFlag(FLAG_S)) PC = addr; break;   // JM
         
         // CALL
         case 0xCD: addr = fetchWord(); push(PC); PC = addr; break; // CALL
-        case 0xC4: addr = fetchWord(); if (!flags.Z) { push(PC); PC = addr; } break; // CNZ
-        case 0xCC: addr = fetchWord(); if (flags.Z) { push(PC); PC = addr; } break;  // CZ
-        case 0xD4: addr = fetchWord(); if (!flags.CY) { push(PC); PC = addr; } break; // CNC
-        case 0xDC: addr = fetchWord(); if (flags.CY) { push(PC); PC = addr; } break;  // CC
-        case 0xE4: addr = fetchWord(); if (!flags.P) { push(PC); PC = addr; } break;  // CPO
-        case 0xEC: addr = fetchWord(); if (flags.P) { push(PC); PC = addr; } break;   // CPE
-        case 0xF4: addr = fetchWord(); if (!flags.S) { push(PC); PC = addr; } break;  // CP
-        case 0xFC: addr = fetchWord(); if (flags.S) { push(PC); PC = addr; } break;   // CM
+        case 0xC4: addr = fetchWord(); if (!getFlag(FLAG_Z)) { push(PC); PC = addr; } break; // CNZ
+        case 0xCC: addr = fetchWord(); if (getFlag(FLAG_Z)) { push(PC); PC = addr; } break;  // CZ
+        case 0xD4: addr = fetchWord(); if (!getFlag(FLAG_CY)) { push(PC); PC = addr; } break; // CNC
+        case 0xDC: addr = fetchWord(); if (getFlag(FLAG_CY)) { push(PC); PC = addr; } break;  // CC
+        case 0xE4: addr = fetchWord(); if (!getFlag(FLAG_P)) { push(PC); PC = addr; } break;  // CPO
+        case 0xEC: addr = fetchWord(); if (getFlag(FLAG_P)) { push(PC); PC = addr; } break;   // CPE
+        case 0xF4: addr = fetchWord(); if (!getFlag(FLAG_S)) { push(PC); PC = addr; } break;  // CP
+        case 0xFC: addr = fetchWord(); if (getFlag(FLAG_S)) { push(PC); PC = addr; } break;   // CM
         
         // RET
         case 0xC9: PC = pop(); break; // RET
-        case 0xC0: if (!flags.Z) PC = pop(); break; // RNZ
-        case 0xC8: if (flags.Z) PC = pop(); break;  // RZ
-        case 0xD0: if (!flags.CY) PC = pop(); break; // RNC
-        case 0xD8: if (flags.CY) PC = pop(); break;  // RC
-        case 0xE0: if (!flags.P) PC = pop(); break;  // RPO
-        case 0xE8: if (flags.P) PC = pop(); break;   // RPE
-        case 0xF0: if (!flags.S) PC = pop(); break;  // RP
-        case 0xF8: if (flags.S) PC = pop(); break;   // RM
+        case 0xC0: if (!getFlag(FLAG_Z)) PC = pop(); break; // RNZ
+        case 0xC8: if (getFlag(FLAG_Z)) PC = pop(); break;  // RZ
+        case 0xD0: if (!getFlag(FLAG_CY)) PC = pop(); break; // RNC
+        case 0xD8: if (getFlag(FLAG_CY)) PC = pop(); break;  // RC
+        case 0xE0: if (!getFlag(FLAG_P)) PC = pop(); break;  // RPO
+        case 0xE8: if (getFlag(FLAG_P)) PC = pop(); break;   // RPE
+        case 0xF0: if (!getFlag(FLAG_S)) PC = pop(); break;  // RP
+        case 0xF8: if (getFlag(FLAG_S)) PC = pop(); break;   // RM
         
         // RST (Restart)
         case 0xC7: push(PC); PC = 0x00; break; case 0xCF: push(PC); PC = 0x08; break;
@@ -274,7 +525,7 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         case 0xC5: push(getBC()); break; // PUSH B
         case 0xD5: push(getDE()); break; // PUSH D
         case 0xE5: push(getHL()); break; // PUSH H
-        case 0xF5: push((A << 8) | (flags.S ? 0x80 : 0) | (flags.Z ? 0x40 : 0) | (flags.AC ? 0x10 : 0) | (flags.P ? 0x04 : 0) | 0x02 | (flags.CY ? 0x01 : 0)); break; // PUSH PSW
+        case 0xF5: push((A << 8) | getFlags()); break; // PUSH PSW
         
         // POP
         case 0xC1: setBC(pop()); break; // POP B
@@ -283,21 +534,17 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         case 0xF1: { // POP PSW
             temp16 = pop();
             A = (temp16 >> 8) & 0xFF;
-            flags.S = (temp16 & 0x80) != 0;
-            flags.Z = (temp16 & 0x40) != 0;
-            flags.AC = (temp16 & 0x10) != 0;
-            flags.P = (temp16 & 0x04) != 0;
-            flags.CY = (temp16 & 0x01) != 0;
+            setFlags(temp16 & 0xFF);
             break;
         }
         
         // XTHL (Exchange HL with top of stack)
         case 0xE3:
             temp8 = memory[SP];
-            memory[SP] = L;
+            writeByte(SP, L);
             L = temp8;
-            temp8 = memory[SP + 1];
-            memory[SP + 1] = H;
+            temp8 = memory[(uint16_t)(SP + 1)];
+            writeByte(SP + 1, H);
             H = temp8;
             break;
         
@@ -307,20 +554,18 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         // IN/OUT (I/O instructions)
         case 0xDB: // IN port
             temp8 = fetchByte();  // port number
-            if (ioReadCallback) {
-                A = ioReadCallback(temp8);
-            } else {
-                A = 0xFF;  // Default: return 0xFF if no callback
-            }
+            if (Config::HOOKS) metrics.port_reads[temp8]++;
+            A = bus.in(temp8);
             break;
         case 0xD3: // OUT port
             temp8 = fetchByte();  // port number
+            if (Config::HOOKS) metrics.port_writes[temp8]++;
             
-            // Port 254 is reserved for bank switching
-            if (temp8 == 254) {
+            // Port 254 is reserved for bank switching when there are banks
+            if (NUM_BANKS > 1 && temp8 == 254) {
                 switchBank(A & 0x07);  // A contains bank number (0-7)
-            } else if (ioWriteCallback) {
-                ioWriteCallback(temp8, A);
+            } else {
+                bus.out(temp8, A);
             }
             break;
         
@@ -328,21 +573,22 @@ void CPU8085::executeInstruction(uint8_t opcode) {
         case 0xFB: interruptEnabled = true; break;  // EI
         case 0xF3: interruptEnabled = false; break; // DI
         
-        // RIM/SIM (8085 specific - Read/Set Interrupt Mask)
-        case 0x20: A = 0; break; // RIM (simplified)
+        // RIM/SIM (8085 specific - Read/Set Interrupt Mask; NOPs on the 8080)
+        case 0x20: if (Config::I8085) A = 0; break; // RIM (simplified)
         case 0x30: break;         // SIM (simplified)
         
-        // Undefined/Illegal opcodes in 8085 - treat as NOP
+        // Undefined/Illegal opcodes in 8085 - treat as NOP. The 8080
+        // decodes them as the documented instruction they alias.
         case 0x08: break; // *NOP (undefined)
         case 0x10: break; // *NOP (undefined)
         case 0x18: break; // *NOP (undefined)
         case 0x28: break; // *NOP (undefined)
         case 0x38: break; // *NOP (undefined)
-        case 0xCB: break; // *NOP (undefined)
-        case 0xD9: break; // *NOP (undefined - RET in 8080, but NOP in 8085)
-        case 0xDD: break; // *NOP (undefined)
-        case 0xED: break; // *NOP (undefined)
-        case 0xFD: break; // *NOP (undefined)
+        case 0xCB: if (!Config::I8085) PC = fetchWord(); break; // *NOP (undefined - JMP in 8080)
+        case 0xD9: if (!Config::I8085) PC = pop(); break;       // *NOP (undefined - RET in 8080)
+        case 0xDD: case 0xED: case 0xFD:                        // *NOP (undefined - CALL in 8080)
+            if (!Config::I8085) { addr = fetchWord(); push(PC); PC = addr; }
+            break;
         
         default:
             // Unknown opcode - should never reach here if all 256 are covered
@@ -350,60 +596,36 @@ void CPU8085::executeInstruction(uint8_t opcode) {
     }
 }
 
-uint8_t CPU8085::add(uint8_t value, bool withCarry) {
-    uint16_t result = A + value + (withCarry && flags.CY ? 1 : 0);
-    flags.CY = (result > 0xFF);
-    flags.AC = ((A & 0x0F) + (value & 0x0F) + (withCarry && flags.CY ? 1 : 0)) > 0x0F;
-    updateFlags(result & 0xFF);
+template<class Config>
+uint8_t BasicCPU8085<Config>::add(uint8_t value, bool withCarry) {
+    uint16_t result = A + value + (withCarry && getFlag(FLAG_CY) ? 1 : 0);
+    setFlagsArith(result, A ^ value);
     return result & 0xFF;
 }
 
-uint8_t CPU8085::sub(uint8_t value, bool withBorrow) {
-    uint16_t result = A - value - (withBorrow && flags.CY ? 1 : 0);
-    flags.CY = (result > 0xFF);
-    flags.AC = ((A & 0x0F) < ((value & 0x0F) + (withBorrow && flags.CY ? 1 : 0)));
-    updateFlags(result & 0xFF);
+// AC is the borrow out of bit 3, mirroring CY
+template<class Config>
+uint8_t BasicCPU8085<Config>::sub(uint8_t value, bool withBorrow) {
+    uint16_t result = A - value - (withBorrow && getFlag(FLAG_CY) ? 1 : 0);
+    setFlagsArith(result, A ^ value);
     return result & 0xFF;
 }
 
-void CPU8085::updateFlags(uint8_t result) {
-    flags.Z = (result == 0);
-    flags.S = (result & 0x80) != 0;
-    
-    // Calculate parity
-    int bits = 0;
-    for (int i = 0; i < 8; i++) {
-        if (result & (1 << i)) bits++;
-    }
-    flags.P = (bits % 2 == 0);
-}
-
-void CPU8085::updateFlagsLogical(uint8_t result) {
-    flags.Z = (result == 0);
-    flags.S = (result & 0x80) != 0;
-    flags.CY = false;  // Logical operations clear carry
-    flags.AC = false;  // Auxiliary carry is reset
-    
-    // Calculate parity
-    int bits = 0;
-    for (int i = 0; i < 8; i++) {
-        if (result & (1 << i)) bits++;
-    }
-    flags.P = (bits % 2 == 0);
-}
-
-void CPU8085::push(uint16_t value) {
-    memory_banks[current_bank][--SP] = (value >> 8) & 0xFF;
-    memory_banks[current_bank][--SP] = value & 0xFF;
+template<class Config>
+void BasicCPU8085<Config>::push(uint16_t value) {
+    writeByte(--SP, (value >> 8) & 0xFF);
+    writeByte(--SP, value & 0xFF);
 }
 
-uint16_t CPU8085::pop() {
-    uint8_t low = memory_banks[current_bank][SP++];
-    uint8_t high = memory_banks[current_bank][SP++];
+template<class Config>
+uint16_t BasicCPU8085<Config>::pop() {
+    uint8_t low = memory_banks[activeBank()][SP++];
+    uint8_t high = memory_banks[activeBank()][SP++];
     return (high << 8) | low;
 }
 
-std::string CPU8085::getRegisterState() const {
+template<class Config>
+std::string BasicCPU8085<Config>::getRegisterState() const {
     std::ostringstream oss;
     oss << std::hex << std::uppercase << std::setfill('0');
     oss << "A:" << std::setw(2) << (int)A << " "
@@ -418,25 +640,30 @@ std::string CPU8085::getRegisterState() const {
     return oss.str();
 }
 
-std::string CPU8085::getFlagsState() const {
+template<class Config>
+std::string BasicCPU8085<Config>::getFlagsState() const {
     std::ostringstream oss;
-    oss << "S:" << flags.S << " "
-        << "Z:" << flags.Z << " "
-        << "AC:" << flags.AC << " "
-        << "P:" << flags.P << " "
-        << "CY:" << flags.CY;
+    oss << "S:" << getFlag(FLAG_S) << " "
+        << "Z:" << getFlag(FLAG_Z) << " "
+        << "AC:" << getFlag(FLAG_AC) << " "
+        << "P:" << getFlag(FLAG_P) << " "
+        << "CY:" << getFlag(FLAG_CY);
     return oss.str();
 }
 
-uint8_t CPU8085::getMemory(uint16_t address) const {
+template<class Config>
+uint8_t BasicCPU8085<Config>::getMemory(uint16_t address) const {
     return memory_banks[current_bank][address];
 }
 
-void CPU8085::setMemory(uint16_t address, uint8_t value) {
+template<class Config>
+void BasicCPU8085<Config>::setMemory(uint16_t address, uint8_t value) {
     memory_banks[current_bank][address] = value;
+    memoryChanged(current_bank, address, 1);
 }
 
-bool CPU8085::loadBinary(const char* filename, uint16_t startAddress) {
+template<class Config>
+bool BasicCPU8085<Config>::loadBinary(const char* filename, uint16_t startAddress) {
     FILE* f = fopen(filename, "rb");
     if (!f) return false;
     
@@ -449,17 +676,22 @@ bool CPU8085::loadBinary(const char* filename, uint16_t startAddress) {
     size_t bytesRead = fread(&memory_banks[current_bank][startAddress], 1, 
                              std::min((long)(65536 - startAddress), size), f);
     fclose(f);
+    memoryChanged(current_bank, startAddress, bytesRead);
     
     return bytesRead > 0;
 }
 
-void CPU8085::loadProgram(const uint8_t* program, size_t size, uint16_t startAddress) {
+template<class Config>
+void BasicCPU8085<Config>::loadProgram(const uint8_t* program, size_t size, uint16_t startAddress) {
     std::memcpy(&memory_banks[current_bank][startAddress], program, size);
+    memoryChanged(current_bank, startAddress, size);
     PC = startAddress;
 }
 
 // Bank switching functions
-void CPU8085::switchBank(int bank) {
+template<class Config>
+void BasicCPU8085<Config>::switchBank(int bank) {
+    if (Config::HOOKS) metrics.bank_switches++;
     if (bank >= 0 && bank < NUM_BANKS) {
         current_bank = bank;
         // Note: memory reference already points to memory_banks[0]
@@ -468,15 +700,158 @@ void CPU8085::switchBank(int bank) {
     }
 }
 
-uint8_t CPU8085::getMemoryFromBank(int bank, uint16_t address) const {
+template<class Config>
+uint8_t BasicCPU8085<Config>::getMemoryFromBank(int bank, uint16_t address) const {
     if (bank >= 0 && bank < NUM_BANKS) {
         return memory_banks[bank][address];
     }
     return 0;
 }
 
-void CPU8085::setMemoryInBank(int bank, uint16_t address, uint8_t value) {
+template<class Config>
+void BasicCPU8085<Config>::setMemoryInBank(int bank, uint16_t address, uint8_t value) {
     if (bank >= 0 && bank < NUM_BANKS) {
         memory_banks[bank][address] = value;
+        memoryChanged(bank, address, 1);
     }
 }
+
+template<class Config>
+void BasicCPU8085<Config>::setMemoryStorage(uint8_t* storage) {
+    for (int i = 0; i < NUM_BANKS; i++) {
+        uint8_t* bank = storage ? storage + i * BANK_SIZE : heap_banks[i];
+        if (bank == memory_banks[i]) continue;
+        std::memcpy(bank, memory_banks[i], BANK_SIZE);
+        memory_banks[i] = bank;
+    }
+}
+
+template<class Config>
+void BasicCPU8085<Config>::copyIntoBank(int bank, uint16_t address, const uint8_t* data, size_t size) {
+    if (bank < 0 || bank >= NUM_BANKS) return;
+    size = std::min(size, (size_t)(65536 - address));
+    std::memcpy(&memory_banks[bank][address], data, size);
+    memoryChanged(bank, address, size);
+}
+
+template<class Config>
+void BasicCPU8085<Config>::memoryChanged(int bank, uint16_t address, size_t size) {
+    if (!Config::HOOKS || size == 0 || bank < 0 || bank >= NUM_BANKS) return;
+    if (framebuffer) framebuffer->markRange(bank, address, size);
+    if (!jit) return;
+    size_t last = std::min((size_t)address + size, (size_t)65536) - 1;
+    for (size_t page = address >> 8; page <= (last >> 8); page++) {
+        if (page_flags[bank][page] & PAGE_CODE) jit->invalidatePage(bank, page);
+    }
+    jit->mirrorMemory(bank, address, size);
+}
+
+template<class Config>
+void BasicCPU8085<Config>::onWatchedWrite(int bank, uint16_t address) {
+    uint8_t flags = page_flags[bank][address >> 8];
+    if ((flags & PAGE_CODE) && jit) {
+        jit->invalidatePage(bank, address >> 8);
+    }
+    if ((flags & PAGE_TASKS) && task_profiler) {
+        task_profiler->onStore(bank, address);
+    }
+    if ((flags & PAGE_VIDEO) && framebuffer) {
+        framebuffer->onStore(bank, address);
+    }
+}
+
+// Block translation tier
+template<class Config>
+void BasicCPU8085<Config>::setJITEnabled(bool enabled) {
+    if (enabled == (jit != nullptr)) return;
+    if (enabled) {
+        // The JIT relies on the page watches to see self-modifying code
+        if constexpr (Config::HOOKS) jit.reset(new JIT(*this));
+    } else {
+        jit.reset();
+    }
+}
+
+template<class Config>
+void BasicCPU8085<Config>::setJITVerify(bool verify) {
+    if (jit) jit->setVerify(verify);
+}
+
+// Metrics
+template<class Config>
+const CPUMetrics& BasicCPU8085<Config>::getMetrics() const {
+    if (jit) jit->foldMetrics();
+    return metrics;
+}
+
+template<class Config>
+void BasicCPU8085<Config>::resetMetrics() {
+    if (jit) jit->foldMetrics();  // Drop anything still pending in the JIT
+    metrics = CPUMetrics();
+    if (timed_run_active) run_start = std::chrono::steady_clock::now();
+}
+
+template<class Config>
+void BasicCPU8085<Config>::beginTimedRun() {
+    run_start = std::chrono::steady_clock::now();
+    timed_run_active = true;
+}
+
+template<class Config>
+void BasicCPU8085<Config>::endTimedRun() {
+    if (!timed_run_active) return;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - run_start;
+    metrics.run_seconds += elapsed.count();
+    timed_run_active = false;
+}
+
+template<class Config>
+std::string BasicCPU8085<Config>::getMetricsJSON() const {
+    getMetrics();  // Fold in counts still held by the JIT
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(6);
+    oss << "{\n"
+        << "  \"instructions\": " << metrics.instructions << ",\n"
+        << "  \"cycles\": " << metrics.cycles << ",\n"
+        << "  \"idle_wakeups\": " << metrics.idle_wakeups << ",\n"
+        << "  \"idle_seconds\": " << metrics.idle_seconds << ",\n"
+        << "  \"bank_switches\": " << metrics.bank_switches << ",\n"
+        << "  \"current_bank\": " << current_bank << ",\n"
+        << "  \"run_seconds\": " << metrics.run_seconds << ",\n"
+        << "  \"emulated_mhz\": " << metrics.emulatedMHz() << ",\n"
+        << "  \"speed_ratio\": " << metrics.speedRatio() << ",\n";
+    
+    oss << "  \"opcode_classes\": {";
+    for (int i = 0; i < (int)OpcodeClass::Count; i++) {
+        OpcodeClass cls = (OpcodeClass)i;
+        oss << (i ? ", " : "") << "\"" << opcodeClassName(cls) << "\": " << metrics.classCount(cls);
+    }
+    oss << "},\n";
+    
+    // Only ports that were actually touched, keyed by decimal port number
+    auto writePorts = [&oss](const char* name, const std::array<uint64_t, 256>& counts) {
+        oss << "  \"" << name << "\": {";
+        bool first = true;
+        for (int port = 0; port < 256; port++) {
+            if (!counts[port]) continue;
+            oss << (first ? "" : ", ") << "\"" << port << "\": " << counts[port];
+            first = false;
+        }
+        oss << "}";
+    };
+    writePorts("port_reads", metrics.port_reads);
+    oss << ",\n";
+    writePorts("port_writes", metrics.port_writes);
+    if (jit) {
+        oss << ",\n  \"jit\": " << jit->getStatsJSON();
+    }
+    if (task_profiler) {
+        oss << ",\n  \"tasks\": " << task_profiler->getReportJSON();
+    }
+    oss << "\n}\n";
+    return oss.str();
+}
+
+template class BasicCPU8085<CPU8085Config>;
+template class BasicCPU8085<FlatCPU8085Config>;
+template class BasicCPU8085<CPU8080Config>;
@@ -5,13 +5,116 @@
 #include <array>
 #include <string>
 #include <functional>
+#include <chrono>
+#include <memory>
+#include "cpu8085fwd.h"
 
 // I/O port callback types
 using IOReadCallback = std::function<uint8_t(uint8_t port)>;
 using IOWriteCallback = std::function<void(uint8_t port, uint8_t value)>;
 
-class CPU8085 {
+// Instruction groups used when reporting opcode counts
+enum class OpcodeClass {
+    DataTransfer,   // MOV, MVI, LXI, LDA/STA, LHLD/SHLD, LDAX/STAX, XCHG
+    Arithmetic,     // ADD/ADC/SUB/SBB, INR/DCR, INX/DCX, DAD, DAA
+    Logical,        // ANA/XRA/ORA/CMP, rotates, CMA/CMC/STC
+    Branch,         // JMP/Jcc, CALL/Ccc, RET/Rcc, RST, PCHL
+    Stack,          // PUSH, POP, XTHL, SPHL
+    IO,             // IN, OUT
+    Control,        // NOP, HLT, EI/DI, RIM/SIM, undefined opcodes
+    Count
+};
+
+const char* opcodeClassName(OpcodeClass cls);
+OpcodeClass classifyOpcode(uint8_t opcode);
+// i8085 false gives the 8080's figures, undefined opcodes included
+uint8_t opcodeCycles(uint8_t opcode, bool i8085 = true);   // T-states (not-taken count for conditionals)
+uint8_t opcodeLength(uint8_t opcode, bool i8085 = true);   // Instruction length in bytes
+
+// Runtime counters. The CPU is driven from a single thread, so these are
+// plain increments in the hot path; totals and rates are derived on read.
+struct CPUMetrics {
+    static constexpr double NOMINAL_CLOCK_MHZ = 3.072;  // 6.144 MHz crystal / 2
+
+    uint64_t instructions = 0;   // Instructions retired
+    uint64_t cycles = 0;         // T-states retired
+    uint64_t idle_wakeups = 0;   // HLTs ended by an interrupt
+    double idle_seconds = 0.0;   // Wall-clock time from those HLTs to the interrupt
+    uint64_t bank_switches = 0;  // switchBank() calls
+    std::array<uint64_t, 256> opcode_counts{};
+    std::array<uint64_t, 256> port_reads{};
+    std::array<uint64_t, 256> port_writes{};
+    double run_seconds = 0.0;    // Wall-clock time spent inside timed runs
+
+    uint64_t classCount(OpcodeClass cls) const;
+    uint64_t totalPortReads() const;
+    uint64_t totalPortWrites() const;
+    double emulatedMHz() const;
+    double speedRatio() const { return emulatedMHz() / NOMINAL_CLOCK_MHZ; }
+};
+
+// Default device bus: IN/OUT go to std::function callbacks. Without a
+// read callback IN returns 0xFF; without a write callback OUT is dropped.
+struct CallbackBus {
+    IOReadCallback read;
+    IOWriteCallback write;
+
+    uint8_t in(uint8_t port) { return read ? read(port) : 0xFF; }
+    void out(uint8_t port, uint8_t value) {
+        if (write) write(port, value);
+    }
+};
+
+// Compile-time CPU configuration. Each field selects a feature, and the
+// ones a configuration leaves out are compiled away:
+//   I8085  true: 8085 (RIM/SIM, undefined opcodes are NOPs, 8085 T-states)
+//          false: 8080 (RIM/SIM are NOPs, undefined opcodes alias JMP, CALL
+//          and RET as on the real chip, 8080 T-states)
+//   BANKS  64 KB banks switched through port 254; 1 is flat memory with no
+//          bank indirection, and port 254 goes to the bus like any other
+//   Bus    device bus with uint8_t in(uint8_t port) and
+//          void out(uint8_t port, uint8_t value)
+//   HOOKS  per-opcode, per-port and bank-switch counters, plus the page
+//          watches behind the block JIT, the task profiler and the
+//          framebuffer. Without them setJITEnabled() does nothing and the
+//          devices are never told about stores; instructions and cycles
+//          are always counted.
+// New configurations go next to these, with explicit instantiations at the
+// end of cpu8085.cpp, blockjit.cpp, taskprofiler.cpp, textframebuffer.cpp
+// and sharedstate.cpp.
+struct CPU8085Config {
+    static constexpr bool I8085 = true;
+    static constexpr int BANKS = 8;
+    using Bus = CallbackBus;
+    static constexpr bool HOOKS = true;
+};
+
+// Plain 64 KB 8085 for batch runs that need no devices or counters
+struct FlatCPU8085Config {
+    static constexpr bool I8085 = true;
+    static constexpr int BANKS = 1;
+    using Bus = CallbackBus;
+    static constexpr bool HOOKS = false;
+};
+
+// 64 KB 8080, with the JIT and the memory-mapped devices available
+struct CPU8080Config {
+    static constexpr bool I8085 = false;
+    static constexpr int BANKS = 1;
+    using Bus = CallbackBus;
+    static constexpr bool HOOKS = true;
+};
+
+template<class Config>
+class BasicCPU8085 {
+    static_assert(Config::BANKS >= 1 && Config::BANKS <= 8, "port 254 selects one of up to 8 banks");
+    
 public:
+    // Devices for this configuration
+    using JIT = BasicBlockJIT<Config>;
+    using Profiler = BasicTaskProfiler<Config>;
+    using Framebuffer = BasicTextFramebuffer<Config>;
+    
     // Registers
     uint8_t A;      // Accumulator
     uint8_t B, C;   // BC register pair
@@ -20,31 +123,69 @@ public:
     uint16_t SP;    // Stack Pointer
     uint16_t PC;    // Program Counter
     
-    // Flags
-    struct Flags {
-        bool S;  // Sign
-        bool Z;  // Zero
-        bool AC; // Auxiliary Carry
-        bool P;  // Parity
-        bool CY; // Carry
-    } flags;
-    
-    // Memory Banking (8 banks × 64KB = 512KB)
-    static constexpr int NUM_BANKS = 8;
-    uint8_t* memory_banks[NUM_BANKS];  // Pointers to heap-allocated banks
+    // Flags, as laid out in the PSW byte: S Z 0 AC 0 P 1 CY
+    static constexpr uint8_t FLAG_S  = 0x80;  // Sign
+    static constexpr uint8_t FLAG_Z  = 0x40;  // Zero
+    static constexpr uint8_t FLAG_AC = 0x10;  // Auxiliary Carry
+    static constexpr uint8_t FLAG_P  = 0x04;  // Parity
+    static constexpr uint8_t FLAG_CY = 0x01;  // Carry
+    static constexpr uint8_t FLAG_ALL = FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY;
+    static constexpr uint8_t PSW_ONE = 0x02;  // Always reads as 1
+    
+    // Flags are evaluated lazily: ALU instructions only record their result,
+    // and each flag is derived from it when something actually reads it
+    // (a conditional branch, PUSH PSW, DAA, or the debugger).
+    uint8_t getFlags() const {  // Packed PSW flag byte
+        return (flag_bits & ~flag_pending) | deriveFlags(flag_pending) | PSW_ONE;
+    }
+    void setFlags(uint8_t psw) {
+        flag_bits = psw & FLAG_ALL;
+        flag_pending = 0;
+    }
+    bool getFlag(uint8_t flag) const {
+        return (flag_pending & flag) ? deriveFlags(flag) != 0 : (flag_bits & flag) != 0;
+    }
+    
+    // Memory Banking (8 banks × 64KB = 512KB by default)
+    static constexpr int NUM_BANKS = Config::BANKS;
+    static constexpr size_t BANK_SIZE = 65536;
+    uint8_t* memory_banks[NUM_BANKS];  // Pointers to the banks (heap, or see setMemoryStorage)
     int current_bank;
     
+    // Per-page watch flags, checked on every guest store
+    static constexpr uint8_t PAGE_CODE = 0x01;  // Page holds translated JIT blocks
+    static constexpr uint8_t PAGE_TASKS = 0x02; // Page holds the profiled task table
+    static constexpr uint8_t PAGE_VIDEO = 0x04; // Page holds the text framebuffer
+    uint8_t page_flags[NUM_BANKS][256];
+    
     // State
     bool halted;
     bool interruptEnabled;
     
-    CPU8085();
-    ~CPU8085();
+    // Pending hardware interrupt (RST-style vector), taken when interrupts are enabled
+    bool interruptPending;
+    uint16_t interruptVector;
+    
+    // Runtime counters (reset together with the CPU)
+    CPUMetrics metrics;
+    
+    BasicCPU8085();
+    ~BasicCPU8085();
     void reset();
     void step();  // Execute one instruction
+    uint64_t run(uint64_t maxSteps);  // Execute up to maxSteps (stops on HLT); returns steps taken
     uint8_t fetchByte();
     uint16_t fetchWord();
     
+    // Raise a hardware interrupt. It is taken at the next step() once
+    // interrupts are enabled. Only a taken interrupt ends HLT: while
+    // interrupts are disabled it stays pending and the CPU stays halted.
+    void requestInterrupt(uint16_t vector);
+    
+    // False while halted with no interrupt that step() would take; run()
+    // returns early then, and callers stop until an interrupt is accepted
+    bool isRunnable() const { return !halted || (interruptPending && interruptEnabled); }
+    
     // Helper functions
     std::string getRegisterState() const;
     std::string getFlagsState() const;
@@ -57,31 +198,149 @@ public:
     uint8_t getMemoryFromBank(int bank, uint16_t address) const;
     void setMemoryInBank(int bank, uint16_t address, uint8_t value);
     
+    // Move the banks into caller-owned storage of NUM_BANKS * BANK_SIZE bytes,
+    // e.g. a shared mapping, keeping their contents; nullptr moves them back
+    // to the heap. The storage must outlive its use here.
+    void setMemoryStorage(uint8_t* storage);
+    
+    // Bulk copy into a bank (DMA); keeps translated code and the screen coherent
+    void copyIntoBank(int bank, uint16_t address, const uint8_t* data, size_t size);
+    // Tell the JIT and the framebuffer about memory changed by anything but a guest store
+    void memoryChanged(int bank, uint16_t address, size_t size);
+    
+    // Block translation tier. Enabled by default; run() falls back to the
+    // interpreter when disabled. Verify mode checks every translated block
+    // against an interpreter-only shadow CPU.
+    void setJITEnabled(bool enabled);
+    bool isJITEnabled() const { return jit != nullptr; }
+    void setJITVerify(bool verify);
+    JIT* getJIT() const { return jit.get(); }
+    
+    // Guest task profiler, owned by the caller; it registers itself
+    void setTaskProfiler(Profiler* profiler) { task_profiler = profiler; }
+    Profiler* getTaskProfiler() const { return task_profiler; }
+    
+    // Memory-mapped text screen, owned by the caller; it registers itself
+    void setFramebuffer(Framebuffer* screen) { framebuffer = screen; }
+    Framebuffer* getFramebuffer() const { return framebuffer; }
+    
     // Load program into memory
     void loadProgram(const uint8_t* program, size_t size, uint16_t startAddress = 0x0000);
     
     // Load binary file (ROM/BIOS) into memory
     bool loadBinary(const char* filename, uint16_t startAddress = 0x0000);
     
-    // I/O port callbacks - set these to handle IN/OUT instructions
-    IOReadCallback ioReadCallback;
-    IOWriteCallback ioWriteCallback;
+    // Metrics - drivers bracket their run loops with begin/endTimedRun so that
+    // emulated speed is measured against wall-clock time actually spent running
+    const CPUMetrics& getMetrics() const;
+    void resetMetrics();
+    void beginTimedRun();
+    void endTimedRun();
+    std::string getMetricsJSON() const;
     
-    // Set I/O callbacks
-    void setIOCallbacks(IOReadCallback readCb, IOWriteCallback writeCb) {
-        ioReadCallback = readCb;
-        ioWriteCallback = writeCb;
+    // Devices behind IN/OUT
+    typename Config::Bus bus;
+    
+    // Set I/O callbacks (CallbackBus only)
+    template<class Read, class Write>
+    void setIOCallbacks(Read readCb, Write writeCb) {
+        bus.read = readCb;
+        bus.write = writeCb;
     }
     
 private:
+    friend JIT;
+    friend Profiler;
+    friend Framebuffer;
+    
+    std::unique_ptr<JIT> jit;
+    Profiler* task_profiler = nullptr;
+    Framebuffer* framebuffer = nullptr;
+    uint8_t* heap_banks[NUM_BANKS];
+    std::chrono::steady_clock::time_point run_start;
+    bool timed_run_active = false;
+    std::chrono::steady_clock::time_point halt_start;  // Last HLT, for idle time
+    
+    // Lazy flag state. Bits set in flag_pending are stale in flag_bits and
+    // come from the last result instead: S, Z and P from its low byte, CY
+    // from bit 8, AC from bit 4 of flag_aux ^ result.
+    uint8_t flag_bits = 0;
+    uint8_t flag_pending = 0;
+    uint16_t flag_result = 0;
+    uint8_t flag_aux = 0;
+    
+    uint8_t deriveFlags(uint8_t mask) const {
+        uint8_t result = flag_result & 0xFF;
+        uint8_t bits = 0;
+        if (mask & FLAG_S) bits |= result & FLAG_S;
+        if ((mask & FLAG_Z) && !result) bits |= FLAG_Z;
+        if (mask & FLAG_AC) bits |= (flag_aux ^ result) & FLAG_AC;
+        if (mask & FLAG_P) {
+            result ^= result >> 4;
+            result ^= result >> 2;
+            result ^= result >> 1;
+            if (!(result & 1)) bits |= FLAG_P;
+        }
+        if (mask & FLAG_CY) bits |= (flag_result >> 8) & FLAG_CY;
+        return bits;
+    }
+    
+    // Move the given pending flags into flag_bits before the result they
+    // depend on is replaced
+    void settleFlags(uint8_t mask) {
+        mask &= flag_pending;
+        if (!mask) return;
+        flag_bits = (flag_bits & ~mask) | deriveFlags(mask);
+        flag_pending &= ~mask;
+    }
+    
+    // ADD/SUB and friends: everything comes from the result. result holds
+    // the carry or borrow in bit 8; aux is the two operands XORed.
+    void setFlagsArith(uint16_t result, uint8_t aux) {
+        flag_result = result;
+        flag_aux = aux;
+        flag_pending = FLAG_ALL;
+    }
+    // ANA/XRA/ORA: CY and AC cleared
+    void setFlagsLogical(uint8_t result) {
+        flag_result = result;
+        flag_aux = result;
+        flag_pending = FLAG_ALL;
+    }
+    // INR/DCR/DAA: S, Z and P only
+    void setFlagsSZP(uint8_t result) {
+        settleFlags(FLAG_AC | FLAG_CY);
+        flag_result = result;
+        flag_pending = FLAG_S | FLAG_Z | FLAG_P;
+    }
+    void setCarry(bool carry) {
+        flag_bits = (flag_bits & ~FLAG_CY) | (carry ? FLAG_CY : 0);
+        flag_pending &= ~FLAG_CY;
+    }
+    
+    // Condition field (bits 3-5) of Jcc/Ccc/Rcc: NZ Z NC C PO PE P M
+    bool conditionMet(uint8_t cc) const {
+        static constexpr uint8_t kFlags[4] = {FLAG_Z, FLAG_CY, FLAG_P, FLAG_S};
+        cc &= 0x07;
+        return getFlag(kFlags[cc >> 1]) == ((cc & 1) != 0);
+    }
+    
     void executeInstruction(uint8_t opcode);
-    void updateFlags(uint8_t result);
-    void updateFlagsLogical(uint8_t result);
     uint8_t add(uint8_t value, bool withCarry = false);
     uint8_t sub(uint8_t value, bool withBorrow = false);
     void push(uint16_t value);
     uint16_t pop();
     
+    // Bank every guest access goes to; a constant with flat memory
+    int activeBank() const { return NUM_BANKS > 1 ? current_bank : 0; }
+    
+    // All guest stores go through here so watched pages are noticed
+    void writeByte(uint16_t address, uint8_t value) {
+        memory_banks[activeBank()][address] = value;
+        if (Config::HOOKS && page_flags[activeBank()][address >> 8]) onWatchedWrite(activeBank(), address);
+    }
+    void onWatchedWrite(int bank, uint16_t address);
+    
     // Helper methods for register pairs
     uint16_t getBC() const { return (B << 8) | C; }
     uint16_t getDE() const { return (D << 8) | E; }
@@ -91,4 +350,12 @@ private:
     void setHL(uint16_t val) { H = (val >> 8) & 0xFF; L = val & 0xFF; }
 };
 
+using FlatCPU8085 = BasicCPU8085<FlatCPU8085Config>;
+using CPU8080 = BasicCPU8085<CPU8080Config>;
+
+// Instantiated once, in cpu8085.cpp
+extern template class BasicCPU8085<CPU8085Config>;
+extern template class BasicCPU8085<FlatCPU8085Config>;
+extern template class BasicCPU8085<CPU8080Config>;
+
 #endif // CPU8085_H
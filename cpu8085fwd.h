@@ -0,0 +1,21 @@
+#ifndef CPU8085FWD_H
+#define CPU8085FWD_H
+
+// Forward declarations for headers that only pass the CPU around
+template<class Config> class BasicCPU8085;
+struct CPU8085Config;
+struct FlatCPU8085Config;
+struct CPU8080Config;
+using CPU8085 = BasicCPU8085<CPU8085Config>;
+
+// Devices are templated on the same configuration as the CPU they attach to
+template<class Config> class BasicBlockJIT;
+template<class Config> class BasicTaskProfiler;
+template<class Config> class BasicTextFramebuffer;
+template<class Config> class BasicSharedState;
+using BlockJIT = BasicBlockJIT<CPU8085Config>;
+using TaskProfiler = BasicTaskProfiler<CPU8085Config>;
+using TextFramebuffer = BasicTextFramebuffer<CPU8085Config>;
+using SharedState = BasicSharedState<CPU8085Config>;
+
+#endif // CPU8085FWD_H
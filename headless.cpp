@@ -0,0 +1,219 @@
+#include "headless.h"
+#include "cpu8085.h"
+#include "blockdevice.h"
+#include "blockjit.h"
+#include "consolebackend.h"
+#include "sharedstate.h"
+#include "taskprofiler.h"
+#include "textframebuffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+int runHeadless(int argc, char* argv[]) {
+    const char* biosPath = "build/bios.bin";
+    const char* inputPath = nullptr;
+    const char* metricsPath = nullptr;
+    const char* diskPath = nullptr;
+    const char* consoleSpec = nullptr;
+    const char* profileSpec = nullptr;
+    const char* screenSpec = nullptr;
+    const char* shmName = nullptr;
+    uint64_t maxInstructions = 10000000;
+    bool useJIT = true;
+    bool verifyJIT = false;
+    bool nativeJIT = true;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--headless")) {
+            continue;
+        } else if (!strcmp(argv[i], "--bios") && hasValue) {
+            biosPath = argv[++i];
+        } else if (!strcmp(argv[i], "--input") && hasValue) {
+            inputPath = argv[++i];
+        } else if (!strcmp(argv[i], "--max-instructions") && hasValue) {
+            maxInstructions = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--metrics-json") && hasValue) {
+            metricsPath = argv[++i];
+        } else if (!strcmp(argv[i], "--disk") && hasValue) {
+            diskPath = argv[++i];
+        } else if (!strcmp(argv[i], "--console") && hasValue) {
+            consoleSpec = argv[++i];
+        } else if (!strcmp(argv[i], "--screen") && hasValue) {
+            screenSpec = argv[++i];
+        } else if (!strcmp(argv[i], "--shm") && hasValue) {
+            shmName = argv[++i];
+        } else if (!strcmp(argv[i], "--profile-tasks") && hasValue) {
+            profileSpec = argv[++i];
+        } else if (!strcmp(argv[i], "--no-jit")) {
+            useJIT = false;
+        } else if (!strcmp(argv[i], "--jit-verify")) {
+            verifyJIT = true;
+        } else if (!strcmp(argv[i], "--jit-threaded")) {
+            nativeJIT = false;
+        } else {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    // Console input is read from a file up front and handed out byte by byte
+    std::vector<uint8_t> input;
+    if (inputPath) {
+        std::ifstream in(inputPath, std::ios::binary);
+        if (!in) {
+            fprintf(stderr, "Could not open input file %s\n", inputPath);
+            return 1;
+        }
+        input.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        translateLineEndings(input.data(), input.size());
+    }
+    size_t inputPos = 0;
+
+    // With --console, ports 0/1 go to a PTY or Unix socket instead
+    ConsoleBackend console;
+    if (consoleSpec) {
+        bool opened;
+        if (!strcmp(consoleSpec, "pty")) {
+            opened = console.openPty();
+        } else if (!strncmp(consoleSpec, "unix:", 5)) {
+            opened = console.listenUnix(consoleSpec + 5);
+        } else {
+            fprintf(stderr, "Console must be 'pty' or 'unix:PATH', got %s\n", consoleSpec);
+            return 2;
+        }
+        if (!opened) {
+            fprintf(stderr, "Could not open console %s\n", consoleSpec);
+            return 1;
+        }
+        fprintf(stderr, "Console on %s\n", console.getPath().c_str());
+    }
+
+    CPU8085 cpu;
+    if (!cpu.loadBinary(biosPath, 0x0000)) {
+        fprintf(stderr, "Could not load BIOS from %s\n", biosPath);
+        return 1;
+    }
+    cpu.PC = 0x0000;
+
+    BlockDevice disk(cpu);
+    if (diskPath && !disk.open(diskPath)) {
+        fprintf(stderr, "Could not open disk image %s\n", diskPath);
+        return 1;
+    }
+
+    cpu.setIOCallbacks(
+        [&](uint8_t port) -> uint8_t {
+            if (disk.handlesPort(port)) {
+                return disk.readPort(port);
+            }
+            if (port == 0) {
+                if (console.isOpen()) return console.readByte();
+                return inputPos < input.size() ? input[inputPos++] : 0;
+            }
+            return 0xFF;
+        },
+        [&](uint8_t port, uint8_t value) {
+            if (disk.handlesPort(port)) {
+                disk.writePort(port, value);
+            } else if (port == 1) {
+                if (console.isOpen()) {
+                    console.writeByte(value);
+                } else {
+                    fputc(value, stdout);
+                }
+            }
+        }
+    );
+
+    cpu.setJITEnabled(useJIT);
+    if (cpu.getJIT()) cpu.getJIT()->setNativeEnabled(nativeJIT);
+    cpu.setJITVerify(verifyJIT);
+
+    std::unique_ptr<TaskProfiler> profiler;
+    if (profileSpec) {
+        TCBLayout layout;
+        if (!parseTCBLayout(profileSpec, layout, CPU8085::NUM_BANKS)) {
+            fprintf(stderr, "Task layout must be 'scheduler', 'os_v03' or "
+                            "'BASE,SIZE,COUNT,STATE,CURRENT[,BANK]', got %s\n", profileSpec);
+            return 2;
+        }
+        profiler.reset(new TaskProfiler(cpu, layout));
+    }
+
+    std::unique_ptr<TextFramebuffer> screen;
+    if (screenSpec) {
+        ScreenLayout layout;
+        if (!parseScreenLayout(screenSpec, layout, CPU8085::NUM_BANKS)) {
+            fprintf(stderr, "Screen must be 'default' or 'COLSxROWS[@BASE[:BANK]]', got %s\n", screenSpec);
+            return 2;
+        }
+        screen.reset(new TextFramebuffer(cpu, layout));
+    }
+
+    SharedState shared(cpu);
+    if (shmName) {
+        if (!shared.open(shmName)) {
+            fprintf(stderr, "Could not create shared memory %s: %s\n", shmName, strerror(errno));
+            return 1;
+        }
+        fprintf(stderr, "Guest state shared at %s\n", shared.getPath().c_str());
+    }
+
+    // Run in batches like the GUI does, servicing devices between batches.
+    // run() returns early on HLT; stop once no interrupt can end it.
+    const uint64_t batchSize = 1000;
+    uint64_t executed = 0;
+    cpu.beginTimedRun();
+    while (maxInstructions == 0 || executed < maxInstructions) {
+        uint64_t batch = batchSize;
+        if (maxInstructions) batch = std::min(batchSize, maxInstructions - executed);
+        executed += cpu.run(batch);
+        disk.service();
+        console.flush();
+        shared.publish();
+        if (!cpu.isRunnable()) break;
+    }
+    cpu.endTimedRun();
+    console.flush();
+    fflush(stdout);
+
+    if (profiler) {
+        std::cerr << profiler->getReport();
+    }
+    if (screen) {
+        const ScreenLayout& layout = screen->getLayout();
+        fprintf(stderr, "Screen %dx%d at bank %d:%04X (%llu stores):\n",
+                layout.columns, layout.rows, layout.bank, layout.base,
+                (unsigned long long)screen->getStores());
+        std::cerr << screen->getText();
+    }
+
+    int status = 0;
+    if (verifyJIT && cpu.getJIT() && cpu.getJIT()->hasDiverged()) {
+        status = 3;
+    }
+
+    if (metricsPath) {
+        std::string json = cpu.getMetricsJSON();
+        if (!strcmp(metricsPath, "-")) {
+            std::cerr << json;
+        } else {
+            std::ofstream out(metricsPath);
+            if (!out) {
+                fprintf(stderr, "Could not write metrics to %s\n", metricsPath);
+                return 1;
+            }
+            out << json;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,29 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Run the emulator without the GUI. Console output (port 1) goes to stdout
+// and console input (port 0) is fed from a file, unless --console attaches
+// both to a PTY or socket. Runtime metrics are written as JSON when the run
+// finishes.
+//
+// Options:
+//   --bios PATH              ROM image loaded at 0x0000 (default build/bios.bin)
+//   --input PATH             Bytes fed to port 0, one per read
+//   --disk PATH              Disk image attached as the block device
+//   --console pty|unix:PATH  Serve ports 0/1 on a pseudo-terminal or Unix socket
+//   --max-instructions N     Stop after N instructions (default 10000000, 0 = no limit)
+//   --metrics-json PATH      Write metrics JSON to PATH ("-" for stderr)
+//   --profile-tasks LAYOUT   Profile guest tasks from the scheduler's TCB table:
+//                            scheduler, os_v03 or BASE,SIZE,COUNT,STATE,CURRENT[,BANK]
+//   --screen LAYOUT          Map a text framebuffer (default or COLSxROWS[@BASE[:BANK]])
+//                            and print its contents when the run ends
+//   --shm NAME|memfd         Run guest memory in a shared-memory object and publish
+//                            registers there after every batch (see sharedstate.h)
+//   --no-jit                 Interpret everything
+//   --jit-verify             Check translated blocks against the interpreter;
+//                            exits with status 3 if they diverge
+//   --jit-threaded           Run translated blocks on their handlers, without
+//                            native code
+int runHeadless(int argc, char* argv[]);
+
+#endif // HEADLESS_H
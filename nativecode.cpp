@@ -0,0 +1,192 @@
+#include "nativecode.h"
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+CodeArena::CodeArena(size_t size)
+    : base(nullptr), size(size), used(0), page_size(sysconf(_SC_PAGESIZE)) {
+    // Reserved inaccessible; add() opens pages as code arrives
+    void* mapped = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped != MAP_FAILED) base = static_cast<uint8_t*>(mapped);
+}
+
+CodeArena::~CodeArena() {
+    if (base) munmap(base, size);
+}
+
+const void* CodeArena::add(const std::vector<uint8_t>& code) {
+    if (!base || code.empty()) return nullptr;
+    size_t start = (used + 15) & ~(size_t)15;
+    if (start + code.size() > size) return nullptr;
+
+    uint8_t* first = base + (start & ~(page_size - 1));
+    uint8_t* last = base + ((start + code.size() + page_size - 1) & ~(page_size - 1));
+    if (mprotect(first, last - first, PROT_READ | PROT_WRITE) != 0) return nullptr;
+    memcpy(base + start, code.data(), code.size());
+    if (mprotect(first, last - first, PROT_READ | PROT_EXEC) != 0) return nullptr;
+    __builtin___clear_cache((char*)base + start, (char*)base + start + code.size());
+
+    used = start + code.size();
+    return base + start;
+}
+
+void CodeArena::clear() {
+    if (!base) return;
+    // Drop the pages too, so a cleared arena costs no memory
+    mmap(base, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    used = 0;
+}
+
+void X64Assembler::imm16(uint16_t value) {
+    byte(value & 0xFF);
+    byte(value >> 8);
+}
+
+void X64Assembler::imm32(uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) byte((value >> shift) & 0xFF);
+}
+
+void X64Assembler::memory(uint8_t reg, int32_t disp) {
+    if (disp >= -128 && disp <= 127) {
+        byte(0x40 | (reg << 3) | RBX);
+        byte(disp & 0xFF);
+    } else {
+        byte(0x80 | (reg << 3) | RBX);
+        imm32(disp);
+    }
+}
+
+void X64Assembler::indexed(uint8_t reg, Reg index, uint8_t scale, int32_t disp) {
+    byte(0x80 | (reg << 3) | RSP);              // SIB follows
+    byte((scale << 6) | (index << 3) | RBX);
+    imm32(disp);
+}
+
+void X64Assembler::loadByte(Reg dst, int32_t disp) { byte(0x0F); byte(0xB6); memory(dst, disp); }
+void X64Assembler::loadWord(Reg dst, int32_t disp) { byte(0x0F); byte(0xB7); memory(dst, disp); }
+void X64Assembler::loadDword(Reg dst, int32_t disp) { byte(0x8B); memory(dst, disp); }
+void X64Assembler::storeByte(int32_t disp, Reg src) { byte(0x88); memory(src, disp); }
+void X64Assembler::storeWord(int32_t disp, Reg src) { byte(0x66); byte(0x89); memory(src, disp); }
+
+void X64Assembler::storeByteImm(int32_t disp, uint8_t value) {
+    byte(0xC6);
+    memory(0, disp);
+    byte(value);
+}
+
+void X64Assembler::storeWordImm(int32_t disp, uint16_t value) {
+    byte(0x66);
+    byte(0xC7);
+    memory(0, disp);
+    imm16(value);
+}
+
+void X64Assembler::addWordImm(int32_t disp, int8_t value) {
+    byte(0x66);
+    byte(0x83);
+    memory(ADD, disp);
+    byte(value);
+}
+
+void X64Assembler::addQwordImm(int32_t disp, int8_t value) {
+    byte(0x48);
+    byte(0x83);
+    memory(ADD, disp);
+    byte(value);
+}
+
+void X64Assembler::andByteImm(int32_t disp, uint8_t value) {
+    byte(0x80);
+    memory(AND, disp);
+    byte(value);
+}
+
+void X64Assembler::loadPointerIndexed(Reg dst, Reg index, int32_t disp) {
+    byte(0x48);
+    byte(0x8B);
+    indexed(dst, index, 3, disp);
+}
+
+void X64Assembler::loadByteIndexed(Reg dst, Reg index, int32_t disp) {
+    byte(0x0F);
+    byte(0xB6);
+    indexed(dst, index, 0, disp);
+}
+
+void X64Assembler::loadByteAt(Reg dst, Reg base, Reg index) {
+    byte(0x0F);
+    byte(0xB6);
+    byte((dst << 3) | RSP);
+    byte((index << 3) | base);
+}
+
+void X64Assembler::storeByteAt(Reg base, Reg index, Reg src) {
+    byte(0x88);
+    byte((src << 3) | RSP);
+    byte((index << 3) | base);
+}
+
+void X64Assembler::movImm(Reg dst, uint32_t value) {
+    byte(0xB8 + dst);
+    imm32(value);
+}
+
+void X64Assembler::movImm64(Reg dst, uint64_t value) {
+    byte(0x48);
+    byte(0xB8 + dst);
+    imm32(value & 0xFFFFFFFF);
+    imm32(value >> 32);
+}
+
+void X64Assembler::mov(Reg dst, Reg src) { byte(0x89); byte(0xC0 | (src << 3) | dst); }
+void X64Assembler::mov64(Reg dst, Reg src) { byte(0x48); byte(0x89); byte(0xC0 | (src << 3) | dst); }
+void X64Assembler::movzxByte(Reg dst, Reg src) { byte(0x0F); byte(0xB6); byte(0xC0 | (dst << 3) | src); }
+void X64Assembler::alu(AluOp op, Reg dst, Reg src) { byte((op << 3) | 0x01); byte(0xC0 | (src << 3) | dst); }
+
+void X64Assembler::aluImm(AluOp op, Reg dst, int32_t value) {
+    if (value >= -128 && value <= 127) {
+        byte(0x83);
+        byte(0xC0 | (op << 3) | dst);
+        byte(value & 0xFF);
+    } else {
+        byte(0x81);
+        byte(0xC0 | (op << 3) | dst);
+        imm32(value);
+    }
+}
+
+void X64Assembler::shl(Reg dst, uint8_t count) { byte(0xC1); byte(0xE0 | dst); byte(count); }
+void X64Assembler::shr(Reg dst, uint8_t count) { byte(0xC1); byte(0xE8 | dst); byte(count); }
+void X64Assembler::notReg(Reg dst) { byte(0xF7); byte(0xD0 | dst); }
+void X64Assembler::testByte(Reg a, Reg b) { byte(0x84); byte(0xC0 | (b << 3) | a); }
+
+void X64Assembler::testImm(Reg dst, uint32_t value) {
+    byte(0xF7);
+    byte(0xC0 | dst);
+    imm32(value);
+}
+
+void X64Assembler::setcc(Cond cond, Reg dst) { byte(0x0F); byte(0x90 | cond); byte(0xC0 | dst); }
+
+X64Assembler::Label X64Assembler::jcc(Cond cond) {
+    byte(0x0F);
+    byte(0x80 | cond);
+    imm32(0);
+    return code.size() - 4;
+}
+
+X64Assembler::Label X64Assembler::jmp() {
+    byte(0xE9);
+    imm32(0);
+    return code.size() - 4;
+}
+
+void X64Assembler::bind(Label label) {
+    uint32_t rel = code.size() - (label + 4);
+    memcpy(&code[label], &rel, 4);
+}
+
+void X64Assembler::push(Reg reg) { byte(0x50 + reg); }
+void X64Assembler::pop(Reg reg) { byte(0x58 + reg); }
+void X64Assembler::call(Reg target) { byte(0xFF); byte(0xD0 | target); }
+void X64Assembler::ret() { byte(0xC3); }
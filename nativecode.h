@@ -0,0 +1,100 @@
+#ifndef NATIVECODE_H
+#define NATIVECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Executable memory for the block JIT's native tier. Code is appended
+// front to back and released all at once by clear(). Pages are only ever
+// writable or executable, never both: add() opens the pages it copies
+// into for writing and seals them again before returning.
+class CodeArena {
+public:
+    static constexpr size_t DEFAULT_SIZE = 8 * 1024 * 1024;
+
+    explicit CodeArena(size_t size = DEFAULT_SIZE);
+    ~CodeArena();
+
+    bool isAvailable() const { return base != nullptr; }
+    size_t getUsed() const { return used; }
+
+    // Copy code in; returns its executable address, or nullptr once full
+    const void* add(const std::vector<uint8_t>& code);
+    void clear();
+
+private:
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    size_t page_size;
+};
+
+// Just enough of an x86-64 encoder for the block JIT. Operands are 32-bit
+// unless the name says otherwise, and byte operands must be AL, CL, DL or
+// BL (no REX prefixes are emitted for them). Memory operands are relative
+// to RBX, where generated code keeps the CPU pointer.
+class X64Assembler {
+public:
+    enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI };
+    enum Cond : uint8_t { O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G };
+    enum AluOp : uint8_t { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+    using Label = size_t;   // Position of a rel32 waiting for bind()
+
+    const std::vector<uint8_t>& getCode() const { return code; }
+    void clear() { code.clear(); }
+
+    // [RBX + disp]
+    void loadByte(Reg dst, int32_t disp);               // movzx dst, byte
+    void loadWord(Reg dst, int32_t disp);               // movzx dst, word
+    void loadDword(Reg dst, int32_t disp);
+    void storeByte(int32_t disp, Reg src);
+    void storeWord(int32_t disp, Reg src);
+    void storeByteImm(int32_t disp, uint8_t value);
+    void storeWordImm(int32_t disp, uint16_t value);
+    void addWordImm(int32_t disp, int8_t value);
+    void addQwordImm(int32_t disp, int8_t value);
+    void andByteImm(int32_t disp, uint8_t value);
+
+    // [RBX + index * 8 + disp] and [RBX + index + disp]
+    void loadPointerIndexed(Reg dst, Reg index, int32_t disp);
+    void loadByteIndexed(Reg dst, Reg index, int32_t disp);
+
+    // [base + index]
+    void loadByteAt(Reg dst, Reg base, Reg index);
+    void storeByteAt(Reg base, Reg index, Reg src);
+
+    void movImm(Reg dst, uint32_t value);
+    void movImm64(Reg dst, uint64_t value);
+    void mov(Reg dst, Reg src);
+    void mov64(Reg dst, Reg src);
+    void movzxByte(Reg dst, Reg src);
+    void alu(AluOp op, Reg dst, Reg src);
+    void aluImm(AluOp op, Reg dst, int32_t value);
+    void shl(Reg dst, uint8_t count);
+    void shr(Reg dst, uint8_t count);
+    void notReg(Reg dst);
+    void testByte(Reg a, Reg b);
+    void testImm(Reg dst, uint32_t value);
+    void setcc(Cond cond, Reg dst);
+
+    Label jcc(Cond cond);
+    Label jmp();
+    void bind(Label label);
+
+    void push(Reg reg);
+    void pop(Reg reg);
+    void call(Reg target);
+    void ret();
+
+private:
+    std::vector<uint8_t> code;
+
+    void byte(uint8_t value) { code.push_back(value); }
+    void imm16(uint16_t value);
+    void imm32(uint32_t value);
+    void memory(uint8_t reg, int32_t disp);    // ModRM (+ disp) for [RBX + disp]
+    void indexed(uint8_t reg, Reg index, uint8_t scale, int32_t disp);
+};
+
+#endif // NATIVECODE_H
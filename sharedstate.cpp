@@ -0,0 +1,135 @@
+#include "sharedstate.h"
+#include "cpu8085.h"
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static_assert(sizeof(SharedStatus) <= SharedState::HEADER_SIZE, "status block must fit the header");
+static_assert(offsetof(SharedStatus, sequence) == 0x18, "status layout is documented");
+static_assert(offsetof(SharedStatus, a) == 0x20, "status layout is documented");
+static_assert(offsetof(SharedStatus, sp) == 0x28, "status layout is documented");
+static_assert(offsetof(SharedStatus, current_bank) == 0x2C, "status layout is documented");
+static_assert(offsetof(SharedStatus, interrupt_vector) == 0x30, "status layout is documented");
+static_assert(offsetof(SharedStatus, instructions) == 0x38, "status layout is documented");
+static_assert(offsetof(SharedStatus, publishes) == 0x48, "status layout is documented");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "sequence is shared between processes");
+
+template<class Config>
+BasicSharedState<Config>::BasicSharedState(CPU& cpu)
+    : cpu(cpu), fd(-1), size(0), mapping(nullptr), status(nullptr) {
+}
+
+template<class Config>
+BasicSharedState<Config>::~BasicSharedState() {
+    close();
+}
+
+template<class Config>
+bool BasicSharedState<Config>::open(const char* objectName) {
+    close();
+
+    if (!strcmp(objectName, "memfd")) {
+        fd = memfd_create("8085-memory", MFD_CLOEXEC);
+        if (fd < 0) return false;
+        path = "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(fd);
+    } else {
+        name = objectName[0] == '/' ? objectName : std::string("/") + objectName;
+        if (name.size() < 2 || name.find('/', 1) != std::string::npos) {
+            name.clear();
+            return false;
+        }
+        // O_EXCL: never take over (and truncate) an object another
+        // emulator is running on; close() would also unlink it
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            name.clear();
+            return false;
+        }
+        path = "/dev/shm" + name;
+    }
+
+    size = HEADER_SIZE + CPU::NUM_BANKS * CPU::BANK_SIZE;
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapped == MAP_FAILED) {
+        int error = errno;
+        close();
+        errno = error;
+        return false;
+    }
+    mapping = static_cast<uint8_t*>(mapped);
+
+    // A fresh object is zero-filled, so the sequence starts even
+    status = new (mapping) SharedStatus();
+    memcpy(status->magic, "8085SHM", 8);
+    status->version = SharedStatus::VERSION;
+    status->header_size = HEADER_SIZE;
+    status->bank_count = CPU::NUM_BANKS;
+    status->bank_size = CPU::BANK_SIZE;
+    status->pid = getpid();
+
+    cpu.setMemoryStorage(mapping + HEADER_SIZE);
+    publish();
+    return true;
+}
+
+template<class Config>
+void BasicSharedState<Config>::close() {
+    if (status) {
+        cpu.setMemoryStorage(nullptr);
+        status = nullptr;
+    }
+    if (mapping) {
+        munmap(mapping, size);
+        mapping = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    if (!name.empty()) {
+        shm_unlink(name.c_str());
+        name.clear();
+    }
+    path.clear();
+}
+
+template<class Config>
+void BasicSharedState<Config>::publish() {
+    if (!status) return;
+
+    // Sequence lock: odd while writing, so readers retry on a torn copy
+    uint32_t sequence = status->sequence.load(std::memory_order_relaxed);
+    status->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    status->a = cpu.A;
+    status->flags = cpu.getFlags();
+    status->b = cpu.B;
+    status->c = cpu.C;
+    status->d = cpu.D;
+    status->e = cpu.E;
+    status->h = cpu.H;
+    status->l = cpu.L;
+    status->sp = cpu.SP;
+    status->pc = cpu.PC;
+    status->current_bank = cpu.current_bank;
+    status->halted = cpu.halted;
+    status->interrupt_enabled = cpu.interruptEnabled;
+    status->interrupt_pending = cpu.interruptPending;
+    status->interrupt_vector = cpu.interruptVector;
+    status->instructions = cpu.metrics.instructions;
+    status->cycles = cpu.metrics.cycles;
+    status->publishes++;
+
+    status->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+template class BasicSharedState<CPU8085Config>;
+template class BasicSharedState<FlatCPU8085Config>;
+template class BasicSharedState<CPU8080Config>;
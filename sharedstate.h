@@ -0,0 +1,99 @@
+#ifndef SHAREDSTATE_H
+#define SHAREDSTATE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "cpu8085fwd.h"
+
+// Status block at the start of the shared object. Every field has a fixed
+// width and offset so readers in any language can decode it; see the layout
+// in SharedState below.
+struct SharedStatus {
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];                       // 0x00  "8085SHM\0"
+    uint32_t version;                    // 0x08
+    uint32_t header_size;                // 0x0C  Offset of bank 0
+    uint32_t bank_count;                 // 0x10
+    uint32_t bank_size;                  // 0x14
+    std::atomic<uint32_t> sequence;      // 0x18  Odd while the fields below are being updated
+    uint32_t pid;                        // 0x1C  Emulator process
+
+    uint8_t a, flags, b, c, d, e, h, l;  // 0x20  flags is the PSW byte (S Z 0 AC 0 P 1 CY)
+    uint16_t sp, pc;                     // 0x28
+    uint8_t current_bank;                // 0x2C
+    uint8_t halted;                      // 0x2D
+    uint8_t interrupt_enabled;           // 0x2E
+    uint8_t interrupt_pending;           // 0x2F
+    uint16_t interrupt_vector;           // 0x30
+    uint16_t reserved0;                  // 0x32
+    uint32_t reserved1;                  // 0x34
+    uint64_t instructions;               // 0x38  Retired since the last reset
+    uint64_t cycles;                     // 0x40  T-states since the last reset
+    uint64_t publishes;                  // 0x48  Times this block was updated
+};
+
+// Guest memory and CPU state exported as one shared-memory object, so
+// monitors and debuggers can watch a running guest without stopping it.
+//
+// Layout (little-endian, as on the host):
+//   0x0000  SharedStatus, padded to HEADER_SIZE
+//   0x1000  bank 0, 65536 bytes
+//   0x11000 bank 1, ... up to bank_count - 1
+//
+// The CPU runs directly on the banks in the mapping, so bank bytes are live:
+// a reader sees each guest store as it happens, with no copying and no
+// pause. Registers are copied into the status block by publish(), which
+// the drivers call after every run batch, under a sequence lock:
+//
+//   do {
+//       s1 = sequence (acquire);        // retry while odd
+//       copy the fields;
+//       s2 = sequence (after an acquire fence);
+//   } while (s1 != s2 || (s1 & 1));
+//
+// Memory read between two equal sequence values was not necessarily written
+// at a single instant; only the status block is covered by the lock.
+//
+// The object is created with mode 0600. Readers open it read-only
+// (shm_open(name, O_RDONLY) or /dev/shm/NAME) and map it with PROT_READ.
+// bank_count follows the CPU's configuration. SharedState is the one for
+// CPU8085.
+template<class Config>
+class BasicSharedState {
+public:
+    using CPU = BasicCPU8085<Config>;
+
+    static constexpr size_t HEADER_SIZE = 4096;
+
+    explicit BasicSharedState(CPU& cpu);
+    ~BasicSharedState();
+
+    // "memfd" for an anonymous memfd (reachable as /proc/PID/fd/N), anything
+    // else a POSIX shared-memory name, with or without the leading '/'.
+    // The name must not exist yet (EEXIST otherwise); errno is set on
+    // failure. Moves the CPU's banks into the mapping.
+    bool open(const char* name);
+    void close();
+
+    bool isOpen() const { return status != nullptr; }
+    // Path other processes open: /dev/shm/NAME or /proc/PID/fd/N
+    const std::string& getPath() const { return path; }
+
+    // Copy registers and counters into the status block
+    void publish();
+
+private:
+    CPU& cpu;
+    std::string name;   // POSIX name to unlink on close; empty for memfd
+    std::string path;
+    int fd;
+    size_t size;
+    uint8_t* mapping;
+    SharedStatus* status;
+};
+
+#endif // SHAREDSTATE_H
@@ -0,0 +1,332 @@
+#include "taskprofiler.h"
+#include "cpu8085.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+const char* const kStateNames[TaskProfiler::STATE_SLOTS] = {
+    "free", "ready", "running", "blocked", "other"
+};
+
+double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+} // namespace
+
+bool parseTCBLayout(const char* spec, TCBLayout& layout, int banks) {
+    TCBLayout parsed;
+    if (!strcmp(spec, "scheduler")) {
+        layout = parsed;
+        return true;
+    }
+    if (!strcmp(spec, "os_v03")) {
+        parsed.base = 0xC000;
+        parsed.count = 32;
+        layout = parsed;
+        return true;
+    }
+
+    // BASE,SIZE,COUNT,STATE,CURRENT[,BANK]; numbers in C syntax (0x8000)
+    unsigned long values[6];
+    int fields = 0;
+    const char* p = spec;
+    for (;;) {
+        if (fields == 6) return false;
+        char* end;
+        values[fields++] = strtoul(p, &end, 0);
+        if (end == p) return false;
+        if (*end == '\0') break;
+        if (*end != ',') return false;
+        p = end + 1;
+    }
+    if (fields < 5) return false;
+
+    parsed.base = values[0];
+    parsed.size = values[1];
+    parsed.count = values[2];
+    parsed.state_offset = values[3];
+    parsed.current_pointer = values[4];
+    if (fields == 6) parsed.bank = values[5];
+
+    if (parsed.size == 0 || parsed.count == 0 || parsed.state_offset >= parsed.size) return false;
+    if ((uint32_t)parsed.base + (uint32_t)parsed.size * parsed.count > 0x10000) return false;
+    if (parsed.current_pointer == 0xFFFF) return false;
+    if (parsed.bank < 0 || parsed.bank >= banks) return false;
+    layout = parsed;
+    return true;
+}
+
+template<class Config>
+BasicTaskProfiler<Config>::BasicTaskProfiler(CPU& cpu, const TCBLayout& layout)
+    : cpu(cpu), layout(layout), table_bytes((uint32_t)layout.size * layout.count), last_seen(0) {
+    restart();
+    watch(true);
+    cpu.setTaskProfiler(this);
+}
+
+template<class Config>
+BasicTaskProfiler<Config>::~BasicTaskProfiler() {
+    cpu.setTaskProfiler(nullptr);
+    watch(false);
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::watch(bool enabled) {
+    uint32_t first = layout.base;
+    uint32_t last = (uint32_t)layout.base + table_bytes - 1;
+    uint8_t* pages = cpu.page_flags[layout.bank];
+    for (uint32_t page = first >> 8; page <= (last >> 8); page++) {
+        if (enabled) pages[page] |= CPU::PAGE_TASKS;
+        else pages[page] &= ~CPU::PAGE_TASKS;
+    }
+    for (uint32_t address : {(uint32_t)layout.current_pointer, (uint32_t)layout.current_pointer + 1}) {
+        if (enabled) pages[address >> 8] |= CPU::PAGE_TASKS;
+        else pages[address >> 8] &= ~CPU::PAGE_TASKS;
+    }
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::restart() {
+    uint64_t at = cpu.metrics.cycles;
+    const uint8_t* memory = cpu.memory_banks[layout.bank];
+
+    stats = Stats();
+    tasks.assign(layout.count, TaskStats());
+    task_states.resize(layout.count);
+    state_since.assign(layout.count, at);
+    for (int task = 0; task < layout.count; task++) {
+        uint8_t state = memory[layout.base + task * layout.size + layout.state_offset];
+        task_states[task] = std::min(state, (uint8_t)STATE_OTHER);
+    }
+
+    start_cycles = at;
+    last_seen = at;
+    current = readCurrent();
+    current_since = at;
+    pointer_pending = false;
+    pointer_since = at;
+    switch_pending = false;
+    switch_start = at;
+}
+
+template<class Config>
+uint64_t BasicTaskProfiler<Config>::now() {
+    // The CPU was reset, and its cycle counter with it; start over
+    if (cpu.metrics.cycles < last_seen) restart();
+    last_seen = cpu.metrics.cycles;
+    return last_seen;
+}
+
+template<class Config>
+int BasicTaskProfiler<Config>::readCurrent() const {
+    const uint8_t* memory = cpu.memory_banks[layout.bank];
+    uint16_t pointer = memory[layout.current_pointer] | (memory[layout.current_pointer + 1] << 8);
+    if (pointer < layout.base) return NO_TASK;
+    uint32_t offset = pointer - layout.base;
+    if (offset >= table_bytes || offset % layout.size) return NO_TASK;
+    return offset / layout.size;
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::recordStore(uint16_t address) {
+    uint64_t at = now();
+
+    if (isPointer(address)) {
+        if (!pointer_pending) {
+            pointer_pending = true;
+            pointer_since = at;
+        }
+        return;
+    }
+    commitPointer();
+
+    uint32_t offset = (uint16_t)(address - layout.base);
+    int task = offset / layout.size;
+
+    if (offset % layout.size == layout.state_offset) {
+        setState(task, cpu.memory_banks[layout.bank][address], at);
+    } else if (task == current) {
+        beginSwitch(at);  // Scheduler saving the running task's context
+    }
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::commitPointer() {
+    if (!pointer_pending) return;
+    pointer_pending = false;
+    setCurrent(readCurrent(), pointer_since);
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::expireSwitch(uint64_t at) {
+    if (switch_pending && at - switch_start > layout.switch_window) {
+        switch_pending = false;
+        stats.abandoned_switches++;
+    }
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::beginSwitch(uint64_t at) {
+    expireSwitch(at);
+    if (switch_pending || current == NO_TASK) return;
+    switch_pending = true;
+    switch_start = at;
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::setCurrent(int task, uint64_t at) {
+    expireSwitch(at);
+    if (task == current) {
+        // Same task dispatched again: whatever hand-over began did not happen
+        if (switch_pending) {
+            switch_pending = false;
+            stats.abandoned_switches++;
+        }
+        return;
+    }
+
+    uint64_t elapsed = at - current_since;
+    if (current == NO_TASK) stats.idle_cycles += elapsed;
+    else tasks[current].cycles += elapsed;
+    current_since = at;
+
+    if (task == NO_TASK) {
+        // Outgoing task is gone and its successor not picked yet
+        beginSwitch(at);
+        current = NO_TASK;
+        return;
+    }
+
+    // From idle with nothing handing over is a first dispatch, not a switch
+    if (switch_pending || current != NO_TASK) {
+        uint64_t latency = switch_pending ? at - switch_start : 0;
+        if (!stats.switches || latency < stats.latency_min) stats.latency_min = latency;
+        if (latency > stats.latency_max) stats.latency_max = latency;
+        stats.latency_total += latency;
+        stats.switches++;
+    }
+    switch_pending = false;
+    current = task;
+    tasks[task].dispatches++;
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::setState(int task, uint8_t state, uint64_t at) {
+    uint8_t slot = std::min(state, (uint8_t)STATE_OTHER);
+    tasks[task].state_cycles[task_states[task]] += at - state_since[task];
+    state_since[task] = at;
+    task_states[task] = slot;
+
+    if (task != current) return;
+    if (slot == STATE_RUNNING) {
+        // Marked running again while still current: it kept the CPU
+        if (switch_pending) {
+            switch_pending = false;
+            stats.abandoned_switches++;
+        }
+    } else {
+        beginSwitch(at);
+    }
+}
+
+template<class Config>
+void BasicTaskProfiler<Config>::sync() {
+    uint64_t at = now();
+    commitPointer();
+    expireSwitch(at);
+
+    uint64_t elapsed = at - current_since;
+    if (current == NO_TASK) stats.idle_cycles += elapsed;
+    else tasks[current].cycles += elapsed;
+    current_since = at;
+
+    for (int task = 0; task < layout.count; task++) {
+        tasks[task].state_cycles[task_states[task]] += at - state_since[task];
+        state_since[task] = at;
+    }
+    stats.total_cycles = at - start_cycles;
+}
+
+template<class Config>
+std::string BasicTaskProfiler<Config>::getReport() {
+    sync();
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1) << std::uppercase << std::hex;
+    oss << "Task profile: " << std::dec << layout.count << " TCBs of " << layout.size
+        << " bytes at 0x" << std::hex << layout.base
+        << ", current pointer at 0x" << layout.current_pointer << std::dec << "\n";
+
+    double seconds = stats.total_cycles / (CPUMetrics::NOMINAL_CLOCK_MHZ * 1e6);
+    oss << "  Cycles profiled:   " << stats.total_cycles << "\n"
+        << "  No task current:   " << stats.idle_cycles
+        << " (" << percent(stats.idle_cycles, stats.total_cycles) << "%)\n"
+        << "  Context switches:  " << stats.switches
+        << " (" << (seconds > 0 ? stats.switches / seconds : 0.0) << "/s at nominal clock), "
+        << stats.abandoned_switches << " abandoned\n";
+    if (stats.switches) {
+        oss << "  Switch latency:    avg " << (double)stats.latency_total / stats.switches
+            << ", min " << stats.latency_min << ", max " << stats.latency_max << " cycles\n";
+    }
+
+    oss << "  Task   CPU %      Cycles  Dispatch   Ready %  Blocked %\n";
+    for (int task = 0; task < layout.count; task++) {
+        const TaskStats& t = tasks[task];
+        if (!t.cycles && !t.dispatches && t.state_cycles[STATE_FREE] == stats.total_cycles) continue;
+        oss << "  " << std::setw(4) << task
+            << std::setw(8) << percent(t.cycles, stats.total_cycles)
+            << std::setw(12) << t.cycles
+            << std::setw(10) << t.dispatches
+            << std::setw(10) << percent(t.state_cycles[STATE_READY], stats.total_cycles)
+            << std::setw(11) << percent(t.state_cycles[STATE_BLOCKED], stats.total_cycles) << "\n";
+    }
+    return oss.str();
+}
+
+template<class Config>
+std::string BasicTaskProfiler<Config>::getReportJSON() {
+    sync();
+    double seconds = stats.total_cycles / (CPUMetrics::NOMINAL_CLOCK_MHZ * 1e6);
+
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(6);
+    oss << "{\"tcb_base\": " << layout.base
+        << ", \"tcb_size\": " << layout.size
+        << ", \"tcb_count\": " << layout.count
+        << ", \"current_pointer\": " << layout.current_pointer
+        << ", \"total_cycles\": " << stats.total_cycles
+        << ", \"idle_cycles\": " << stats.idle_cycles
+        << ", \"switches\": " << stats.switches
+        << ", \"abandoned_switches\": " << stats.abandoned_switches
+        << ", \"switches_per_second\": " << (seconds > 0 ? stats.switches / seconds : 0.0)
+        << ", \"latency_avg\": " << (stats.switches ? (double)stats.latency_total / stats.switches : 0.0)
+        << ", \"latency_min\": " << stats.latency_min
+        << ", \"latency_max\": " << stats.latency_max
+        << ", \"tasks\": [";
+
+    bool first = true;
+    for (int task = 0; task < layout.count; task++) {
+        const TaskStats& t = tasks[task];
+        if (!t.cycles && !t.dispatches && t.state_cycles[STATE_FREE] == stats.total_cycles) continue;
+        oss << (first ? "" : ", ") << "{\"id\": " << task
+            << ", \"cycles\": " << t.cycles
+            << ", \"cpu_share\": " << percent(t.cycles, stats.total_cycles) / 100.0
+            << ", \"dispatches\": " << t.dispatches;
+        for (int slot = 0; slot < STATE_SLOTS; slot++) {
+            oss << ", \"" << kStateNames[slot] << "_cycles\": " << t.state_cycles[slot];
+        }
+        oss << ", \"blocked_share\": " << percent(t.state_cycles[STATE_BLOCKED], stats.total_cycles) / 100.0
+            << "}";
+        first = false;
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+template class BasicTaskProfiler<CPU8085Config>;
+template class BasicTaskProfiler<FlatCPU8085Config>;
+template class BasicTaskProfiler<CPU8080Config>;
@@ -0,0 +1,141 @@
+#ifndef TASKPROFILER_H
+#define TASKPROFILER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu8085fwd.h"
+
+// Where the guest scheduler keeps its Task Control Blocks. Defaults match
+// src/scheduler.asm; src/os_v03.asm uses base 0xC000 and 32 tasks.
+struct TCBLayout {
+    uint16_t base = 0x8000;             // TCB_BASE
+    uint16_t size = 16;                 // TCB_SIZE
+    uint16_t count = 8;                 // MAX_TASKS
+    uint16_t state_offset = 2;          // TCB_STATE (low byte)
+    uint16_t current_pointer = 0xFFF0;  // CURRENT_TCB: address of the running TCB, 0 if none
+    int bank = 0;                       // Bank holding both
+    uint64_t switch_window = 20000;     // Cycles a started switch may take before it counts as abandoned
+};
+
+// Parse "scheduler", "os_v03" or "BASE,SIZE,COUNT,STATE,CURRENT[,BANK]";
+// BANK must be below banks, the NUM_BANKS of the CPU the profiler attaches to
+bool parseTCBLayout(const char* spec, TCBLayout& layout, int banks);
+
+// Guest-aware profiler for the TCB-based schedulers.
+//
+// Nothing in the guest is instrumented. The pages holding the task table and
+// the current-task pointer are watched (PAGE_TASKS), so every guest
+// store there is seen as it happens and timestamped with the cycle counter:
+//   - cycles between changes of CURRENT_TCB are charged to that task, or to
+//     "no task" while the pointer is 0 or outside the table;
+//   - writes to a TCB's state byte track how long each task spends ready,
+//     running and blocked;
+//   - a context switch starts when the running task's TCB is written (its
+//     context being saved or its state changed) or the pointer is cleared,
+//     and ends when the pointer names a different task. That span is the
+//     switch latency. A started switch that dispatches the same task again,
+//     or nothing within switch_window cycles, is counted as abandoned.
+//
+// Pointer updates are committed once the guest stores anything else in the
+// table (or at sync()), so a pointer written one byte at a time is
+// never seen half-updated. With the JIT on, stores inside a translated
+// block are timestamped at the block's start; run with the JIT off for
+// exact latencies.
+//
+// Needs a configuration with HOOKS for the page watch; layout.bank must be
+// one of the CPU's banks. TaskProfiler is the one for CPU8085.
+template<class Config>
+class BasicTaskProfiler {
+public:
+    using CPU = BasicCPU8085<Config>;
+
+    static constexpr int NO_TASK = -1;
+
+    enum State : uint8_t {
+        STATE_FREE = 0,
+        STATE_READY = 1,
+        STATE_RUNNING = 2,
+        STATE_BLOCKED = 3,
+        STATE_OTHER = 4,    // Anything the scheduler does not define
+        STATE_SLOTS = 5
+    };
+
+    struct TaskStats {
+        uint64_t cycles = 0;                    // Cycles while this was the current task
+        uint64_t dispatches = 0;                // Times it became the current task
+        uint64_t state_cycles[STATE_SLOTS] = {};
+    };
+
+    struct Stats {
+        uint64_t total_cycles = 0;       // Cycles since profiling (re)started
+        uint64_t idle_cycles = 0;        // Cycles with no current task
+        uint64_t switches = 0;
+        uint64_t abandoned_switches = 0;
+        uint64_t latency_total = 0;
+        uint64_t latency_min = 0;
+        uint64_t latency_max = 0;
+    };
+
+    BasicTaskProfiler(CPU& cpu, const TCBLayout& layout);
+    ~BasicTaskProfiler();
+
+    // Start over from the current memory contents
+    void restart();
+
+    // Called from the CPU for guest stores to a PAGE_TASKS page. The
+    // pointer usually shares its page with the stack, so stores to anything
+    // but the pointer and the table are dropped here, before any work.
+    void onStore(int bank, uint16_t address) {
+        if (bank != layout.bank) return;
+        if (isPointer(address) || (uint16_t)(address - layout.base) < table_bytes) recordStore(address);
+    }
+
+    // Close open intervals up to the current cycle count
+    void sync();
+
+    const TCBLayout& getLayout() const { return layout; }
+    int getCurrentTask() const { return current; }
+    const Stats& getStats() const { return stats; }
+    const std::vector<TaskStats>& getTaskStats() const { return tasks; }
+
+    // Both sync() first
+    std::string getReport();
+    std::string getReportJSON();
+
+private:
+    CPU& cpu;
+    TCBLayout layout;
+    uint32_t table_bytes;     // layout.size * layout.count
+    Stats stats;
+    std::vector<TaskStats> tasks;
+    std::vector<uint8_t> task_states;
+    std::vector<uint64_t> state_since;
+
+    uint64_t start_cycles;
+    uint64_t last_seen;
+    int current;
+    uint64_t current_since;
+
+    bool pointer_pending;     // CURRENT_TCB written, not yet committed
+    uint64_t pointer_since;
+
+    bool switch_pending;      // Outgoing task has started handing over
+    uint64_t switch_start;
+
+    uint64_t now();
+    void watch(bool enabled);
+    bool isPointer(uint16_t address) const {
+        return address == layout.current_pointer || address == (uint16_t)(layout.current_pointer + 1);
+    }
+    void recordStore(uint16_t address);
+    int readCurrent() const;
+    void commitPointer();
+    void expireSwitch(uint64_t at);
+    void beginSwitch(uint64_t at);
+    void setCurrent(int task, uint64_t at);
+    void setState(int task, uint8_t state, uint64_t at);
+};
+
+#endif // TASKPROFILER_H
@@ -0,0 +1,53 @@
+// Layout parsers against the bank count of each CPU configuration (see README)
+#include "cpu8085.h"
+#include "taskprofiler.h"
+#include "textframebuffer.h"
+#include <cstdio>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+template<class Config>
+void checkBanks(const char* name) {
+    const int banks = BasicCPU8085<Config>::NUM_BANKS;
+    TCBLayout tasks;
+    ScreenLayout screen;
+    char spec[64];
+
+    snprintf(spec, sizeof(spec), "0x8000,16,8,2,0xFFF0,%d", banks - 1);
+    expect(parseTCBLayout(spec, tasks, banks) && tasks.bank == banks - 1, name);
+    snprintf(spec, sizeof(spec), "0x8000,16,8,2,0xFFF0,%d", banks);
+    expect(!parseTCBLayout(spec, tasks, banks), name);
+
+    snprintf(spec, sizeof(spec), "80x25@0xE000:%d", banks - 1);
+    expect(parseScreenLayout(spec, screen, banks) && screen.bank == banks - 1, name);
+    snprintf(spec, sizeof(spec), "80x25@0xE000:%d", banks);
+    expect(!parseScreenLayout(spec, screen, banks), name);
+}
+
+} // namespace
+
+int main() {
+    checkBanks<CPU8085Config>("CPU8085 bank range");
+    checkBanks<FlatCPU8085Config>("FlatCPU8085 bank range");
+    checkBanks<CPU8080Config>("CPU8080 bank range");
+
+    // The 8080 has a single bank, so bank 1 must never reach page_flags
+    const int banks = CPU8080::NUM_BANKS;
+    TCBLayout tasks;
+    ScreenLayout screen;
+    expect(!parseTCBLayout("0x8000,16,8,2,0xFFF0,1", tasks, banks), "CPU8080 task table in bank 1");
+    expect(!parseScreenLayout("80x25@0xE000:1", screen, banks), "CPU8080 screen in bank 1");
+
+    if (failures) return 1;
+    printf("layouttest: ok\n");
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "textframebuffer.h"
+#include "cpu8085.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+bool parseScreenLayout(const char* spec, ScreenLayout& layout, int banks) {
+    ScreenLayout parsed;
+    if (!strcmp(spec, "default")) {
+        layout = parsed;
+        return true;
+    }
+
+    char* end;
+    unsigned long columns = strtoul(spec, &end, 10);
+    if (end == spec || *end != 'x') return false;
+    const char* p = end + 1;
+    unsigned long rows = strtoul(p, &end, 10);
+    if (end == p) return false;
+
+    unsigned long base = parsed.base;
+    unsigned long bank = parsed.bank;
+    if (*end == '@') {
+        p = end + 1;
+        base = strtoul(p, &end, 0);
+        if (end == p) return false;
+        if (*end == ':') {
+            p = end + 1;
+            bank = strtoul(p, &end, 0);
+            if (end == p) return false;
+        }
+    }
+    if (*end != '\0') return false;
+
+    if (columns == 0 || columns > 255 || rows == 0 || rows > 255) return false;
+    if (bank >= (unsigned long)banks) return false;
+    parsed.columns = columns;
+    parsed.rows = rows;
+    if (base + parsed.bytes() > 0x10000) return false;
+    parsed.base = base;
+    parsed.bank = bank;
+    layout = parsed;
+    return true;
+}
+
+template<class Config>
+BasicTextFramebuffer<Config>::BasicTextFramebuffer(CPU& cpu, const ScreenLayout& layout)
+    : cpu(cpu), layout(layout), row_dirty(layout.rows, 1), dirty(true), stores(0) {
+    watch(true);
+    cpu.setFramebuffer(this);
+}
+
+template<class Config>
+BasicTextFramebuffer<Config>::~BasicTextFramebuffer() {
+    cpu.setFramebuffer(nullptr);
+    watch(false);
+}
+
+template<class Config>
+void BasicTextFramebuffer<Config>::watch(bool enabled) {
+    uint32_t last = layout.base + layout.bytes() - 1;
+    for (uint32_t page = layout.base >> 8; page <= (last >> 8); page++) {
+        if (enabled) cpu.page_flags[layout.bank][page] |= CPU::PAGE_VIDEO;
+        else cpu.page_flags[layout.bank][page] &= ~CPU::PAGE_VIDEO;
+    }
+}
+
+template<class Config>
+void BasicTextFramebuffer<Config>::markRange(int bank, uint16_t address, size_t size) {
+    if (bank != layout.bank || size == 0) return;
+    uint32_t start = std::max<uint32_t>(address, layout.base);
+    uint32_t end = std::min<uint32_t>((uint32_t)address + size, layout.base + layout.bytes());
+    if (start >= end) return;
+    uint32_t first = (start - layout.base) / layout.rowBytes();
+    uint32_t last = (end - 1 - layout.base) / layout.rowBytes();
+    std::fill(row_dirty.begin() + first, row_dirty.begin() + last + 1, 1);
+    dirty = true;
+}
+
+template<class Config>
+void BasicTextFramebuffer<Config>::markAllDirty() {
+    std::fill(row_dirty.begin(), row_dirty.end(), 1);
+    dirty = true;
+}
+
+template<class Config>
+void BasicTextFramebuffer<Config>::clearDirty() {
+    std::fill(row_dirty.begin(), row_dirty.end(), 0);
+    dirty = false;
+}
+
+template<class Config>
+const uint8_t* BasicTextFramebuffer<Config>::cell(int row, int column) const {
+    return cpu.memory_banks[layout.bank] + layout.base + row * layout.rowBytes() + column * 2;
+}
+
+template<class Config>
+std::string BasicTextFramebuffer<Config>::getText() const {
+    std::string text;
+    for (int row = 0; row < layout.rows; row++) {
+        std::string line;
+        for (int column = 0; column < layout.columns; column++) {
+            uint8_t ch = getChar(row, column);
+            line += (ch >= 0x20 && ch < 0x7F) ? (char)ch : ' ';
+        }
+        line.erase(line.find_last_not_of(' ') + 1);
+        text += line;
+        text += '\n';
+    }
+    return text;
+}
+
+template class BasicTextFramebuffer<CPU8085Config>;
+template class BasicTextFramebuffer<FlatCPU8085Config>;
+template class BasicTextFramebuffer<CPU8080Config>;
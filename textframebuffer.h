@@ -0,0 +1,97 @@
+#ifndef TEXTFRAMEBUFFER_H
+#define TEXTFRAMEBUFFER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "cpu8085fwd.h"
+
+// Where the text screen lives in guest memory
+struct ScreenLayout {
+    uint16_t columns = 80;
+    uint16_t rows = 25;
+    uint16_t base = 0xE000;  // Clear of the BIOS, the OS images and the stack at 0xFFFE
+    int bank = 0;
+
+    uint32_t rowBytes() const { return (uint32_t)columns * 2; }
+    uint32_t bytes() const { return rowBytes() * rows; }
+};
+
+// Parse "default" or "COLSxROWS[@BASE[:BANK]]", e.g. "80x25@0xE000";
+// BANK must be below banks, the NUM_BANKS of the CPU the screen attaches to
+bool parseScreenLayout(const char* spec, ScreenLayout& layout, int banks);
+
+// Memory-mapped text screen.
+//
+// Cell (row, col) is two bytes at base + (row * columns + col) * 2: the
+// character, then its attribute. Guests draw with plain MOV/STAX/SHLD, so a
+// full-screen redraw costs a few thousand stores instead of a port write and
+// a terminal insert per character.
+//
+// Attribute byte:
+//   bits 0-3  foreground colour (CGA palette, 8-15 bright)
+//   bits 4-6  background colour (CGA palette 0-7)
+//   bit  7    underline
+// An attribute of 0 is shown as DEFAULT_ATTRIBUTE, so text written without
+// attributes, or into freshly cleared memory, stays visible.
+//
+// The pages holding the screen are watched (PAGE_VIDEO). Each store marks
+// its row dirty, and a renderer redraws only dirty rows at its own frame
+// rate. That needs a configuration with HOOKS; layout.bank must be one of
+// the CPU's banks. TextFramebuffer is the one for CPU8085.
+template<class Config>
+class BasicTextFramebuffer {
+public:
+    using CPU = BasicCPU8085<Config>;
+
+    static constexpr uint8_t DEFAULT_ATTRIBUTE = 0x07;  // Light grey on black
+    static constexpr uint8_t ATTR_UNDERLINE = 0x80;
+
+    BasicTextFramebuffer(CPU& cpu, const ScreenLayout& layout);
+    ~BasicTextFramebuffer();
+
+    const ScreenLayout& getLayout() const { return layout; }
+
+    // Called from the CPU for guest stores to a PAGE_VIDEO page
+    void onStore(int bank, uint16_t address) {
+        if (bank != layout.bank || address < layout.base) return;
+        uint32_t offset = address - layout.base;
+        if (offset >= layout.bytes()) return;
+        row_dirty[offset / layout.rowBytes()] = 1;
+        dirty = true;
+        stores++;
+    }
+
+    // Memory changed other than by guest stores (loads, DMA, reset)
+    void markRange(int bank, uint16_t address, size_t size);
+    void markAllDirty();
+
+    bool isDirty() const { return dirty; }
+    bool isRowDirty(int row) const { return row_dirty[row] != 0; }
+    void clearDirty();
+
+    uint8_t getChar(int row, int column) const { return cell(row, column)[0]; }
+    uint8_t getAttribute(int row, int column) const {
+        uint8_t attribute = cell(row, column)[1];
+        return attribute ? attribute : DEFAULT_ATTRIBUTE;
+    }
+
+    // Screen contents as text, one line per row, trailing blanks trimmed
+    std::string getText() const;
+
+    uint64_t getStores() const { return stores; }
+
+private:
+    CPU& cpu;
+    ScreenLayout layout;
+    std::vector<uint8_t> row_dirty;
+    bool dirty;
+    uint64_t stores;
+
+    const uint8_t* cell(int row, int column) const;
+    void watch(bool enabled);
+};
+
+#endif // TEXTFRAMEBUFFER_H
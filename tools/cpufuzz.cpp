@@ -0,0 +1,955 @@
+// Differential fuzzer for the CPU core.
+//
+// Random machine states and instruction sequences are run on the CPU cores
+// (CPU8085 interpreted, with the block JIT compiling to native code, and
+// with the JIT on its threaded handlers alone; FlatCPU8085; CPU8080
+// interpreted and with the JIT) and on RefCPU below, an independent
+// and deliberately plain model with eagerly computed flags, decoded from
+// the opcode bit fields rather than a 256-way switch. After every case the
+// registers, flags, cycle count, port traffic and memory are compared. A
+// divergence is minimized (fewer steps, shorter program, fewer live
+// registers, zeroed memory) and printed with a line --replay accepts.
+//
+// Usage: cpufuzz [--threads N] [--seconds S] [--cases N] [--seed S]
+//                [--steps N] [--core CORES] [--replay CASE]
+// CORES is a comma-separated list of interp, jit, threaded, flat, i8080 and
+// i8080-jit, or all (the default); both means interp,jit.
+// Exits with 1 if the core diverged from the reference, 0 otherwise.
+
+#include "cpu8085.h"
+#include "blockjit.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+constexpr int NUM_BANKS = CPU8085::NUM_BANKS;
+constexpr size_t BANK_SIZE = CPU8085::BANK_SIZE;
+constexpr uint8_t BANK_PORT = 254;
+constexpr uint32_t JIT_RESTART_CASES = 256;  // Before SMC page limits start to bite
+
+// The cores under test
+enum Core {
+    CORE_INTERP, CORE_JIT, CORE_THREADED,   // CPU8085
+    CORE_FLAT,                              // FlatCPU8085
+    CORE_I8080, CORE_I8080_JIT,             // CPU8080
+    NUM_CORES
+};
+const char* const kCoreNames[NUM_CORES] = {"interp", "jit", "threaded", "flat", "i8080", "i8080-jit"};
+const uint32_t ALL_CORES = (1u << NUM_CORES) - 1;   // Bit per Core
+
+uint64_t splitmix(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Port traffic seen by one model during a case. IN returns a value that
+// depends only on the port and how many reads came before.
+struct IOTrace {
+    uint32_t reads = 0;
+    std::vector<std::pair<uint8_t, uint8_t>> writes;
+
+    uint8_t read(uint8_t port) {
+        uint64_t state = ((uint64_t)port << 32) | reads++;
+        return splitmix(state) & 0xFF;
+    }
+    void write(uint8_t port, uint8_t value) { writes.emplace_back(port, value); }
+    void clear() {
+        reads = 0;
+        writes.clear();
+    }
+};
+
+// Reference 8085 model, written from the Intel data sheet, with an 8080
+// mode written from the 8080 manual. Where this emulator deliberately
+// departs from silicon, the reference follows the emulator, so those
+// choices are checked too:
+//   - INR, DCR and DAA leave AC alone; logical operations clear AC and CY
+//   - AC after SUB/SBB/CMP is the borrow out of bit 3
+//   - 8085: RIM loads 0, SIM does nothing, the ten undefined opcodes are NOPs
+//   - 8080: RIM and SIM are NOPs; 0xCB is JMP, 0xD9 RET, 0xDD/0xED/0xFD CALL
+//   - banked: OUT to port 254 selects the memory bank (A & 7) instead of a device
+class RefCPU {
+public:
+    enum { B, C, D, E, H, L, M, A };
+    static constexpr uint8_t S = 0x80, Z = 0x40, AC = 0x10, P = 0x04, CY = 0x01;
+
+    bool i8085 = true;      // false for the 8080
+    bool banked = true;     // false for flat memory
+
+    uint8_t r[8] = {};
+    uint8_t f = 0;
+    uint16_t sp = 0, pc = 0;
+    bool halted = false;
+    bool ie = false;
+    int bank = 0;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    std::vector<uint8_t> memory = std::vector<uint8_t>(NUM_BANKS * BANK_SIZE);
+    std::vector<std::pair<uint32_t, uint8_t>> undo;  // (bank address, old value) per store
+    IOTrace* io = nullptr;
+
+    uint8_t read(uint16_t address) const { return memory[bank * BANK_SIZE + address]; }
+    void write(uint16_t address, uint8_t value) {
+        uint32_t at = bank * BANK_SIZE + address;
+        undo.emplace_back(at, memory[at]);
+        memory[at] = value;
+    }
+    void rollback() {
+        for (size_t i = undo.size(); i-- > 0;) memory[undo[i].first] = undo[i].second;
+        undo.clear();
+    }
+
+    uint64_t run(uint64_t steps) {
+        uint64_t done = 0;
+        while (done < steps && !halted) {
+            step();
+            done++;
+        }
+        return done;
+    }
+
+    void step() {
+        uint8_t op = fetch();
+        instructions++;
+        int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+        switch (x) {
+            case 0: group0(op, y, z); break;
+            case 1:
+                if (op == 0x76) {
+                    halted = true;
+                    cycles += t(5, 7);
+                } else {
+                    setReg(y, reg(z));
+                    cycles += (y == M || z == M) ? 7 : t(4, 5);
+                }
+                break;
+            case 2:
+                alu(y, reg(z));
+                cycles += z == M ? 7 : 4;
+                break;
+            default: group3(op, y, z); break;
+        }
+    }
+
+private:
+    // T-states on the 8085 and on the 8080
+    int t(int i8085Cycles, int i8080Cycles) const { return i8085 ? i8085Cycles : i8080Cycles; }
+
+    uint8_t fetch() { return read(pc++); }
+    uint16_t fetch16() {
+        uint8_t low = fetch();
+        return low | (fetch() << 8);
+    }
+    uint16_t hl() const { return (r[H] << 8) | r[L]; }
+    uint8_t reg(int i) const { return i == M ? read(hl()) : r[i]; }
+    void setReg(int i, uint8_t v) {
+        if (i == M) write(hl(), v);
+        else r[i] = v;
+    }
+    // Register pairs BC, DE, HL, SP (or PSW for PUSH/POP)
+    uint16_t pair(int rp) const { return rp == 3 ? sp : (r[rp * 2] << 8) | r[rp * 2 + 1]; }
+    void setPair(int rp, uint16_t v) {
+        if (rp == 3) {
+            sp = v;
+        } else {
+            r[rp * 2] = v >> 8;
+            r[rp * 2 + 1] = v & 0xFF;
+        }
+    }
+    void push(uint16_t v) {
+        write(--sp, v >> 8);
+        write(--sp, v & 0xFF);
+    }
+    uint16_t pop() {
+        uint8_t low = read(sp++);
+        return low | (read(sp++) << 8);
+    }
+
+    static uint8_t szp(uint8_t v) {
+        int ones = 0;
+        for (int bit = 0; bit < 8; bit++) ones += (v >> bit) & 1;
+        return (v & S) | (v ? 0 : Z) | (ones % 2 ? 0 : P);
+    }
+    void setCarry(bool carry) { f = (f & ~CY) | (carry ? CY : 0); }
+
+    uint8_t add(uint8_t a, uint8_t b, int carry) {
+        int sum = a + b + carry;
+        f = szp(sum & 0xFF) | (((a & 0x0F) + (b & 0x0F) + carry) > 0x0F ? AC : 0) | (sum > 0xFF ? CY : 0);
+        return sum & 0xFF;
+    }
+    uint8_t sub(uint8_t a, uint8_t b, int borrow) {
+        int diff = a - b - borrow;
+        f = szp(diff & 0xFF) | ((a & 0x0F) < (b & 0x0F) + borrow ? AC : 0) | (diff < 0 ? CY : 0);
+        return diff & 0xFF;
+    }
+    void alu(int operation, uint8_t v) {
+        int carry = f & CY;
+        switch (operation) {
+            case 0: r[A] = add(r[A], v, 0); break;
+            case 1: r[A] = add(r[A], v, carry); break;
+            case 2: r[A] = sub(r[A], v, 0); break;
+            case 3: r[A] = sub(r[A], v, carry); break;
+            case 4: r[A] &= v; f = szp(r[A]); break;
+            case 5: r[A] ^= v; f = szp(r[A]); break;
+            case 6: r[A] |= v; f = szp(r[A]); break;
+            case 7: sub(r[A], v, 0); break;
+        }
+    }
+
+    bool condition(int cc) const {
+        static const uint8_t kMask[4] = {Z, CY, P, S};
+        bool set = (f & kMask[cc >> 1]) != 0;
+        return (cc & 1) ? set : !set;
+    }
+
+    void group0(uint8_t op, int y, int z) {
+        int rp = y >> 1;
+        switch (z) {
+            case 0:
+                if (op == 0x20 && i8085) r[A] = 0;  // RIM; NOP, SIM and the undefined ones do nothing
+                cycles += 4;
+                break;
+            case 1:
+                if (y & 1) {  // DAD
+                    uint32_t sum = hl() + pair(rp);
+                    setPair(2, sum & 0xFFFF);
+                    setCarry(sum > 0xFFFF);
+                    cycles += 10;
+                } else {      // LXI
+                    setPair(rp, fetch16());
+                    cycles += 10;
+                }
+                break;
+            case 2: {
+                uint16_t address;
+                switch (y) {
+                    case 0: write(pair(0), r[A]); cycles += 7; break;            // STAX B
+                    case 1: r[A] = read(pair(0)); cycles += 7; break;            // LDAX B
+                    case 2: write(pair(1), r[A]); cycles += 7; break;            // STAX D
+                    case 3: r[A] = read(pair(1)); cycles += 7; break;            // LDAX D
+                    case 4:                                                      // SHLD
+                        address = fetch16();
+                        write(address, r[L]);
+                        write(address + 1, r[H]);
+                        cycles += 16;
+                        break;
+                    case 5:                                                      // LHLD
+                        address = fetch16();
+                        r[L] = read(address);
+                        r[H] = read(address + 1);
+                        cycles += 16;
+                        break;
+                    case 6: write(fetch16(), r[A]); cycles += 13; break;         // STA
+                    case 7: r[A] = read(fetch16()); cycles += 13; break;         // LDA
+                }
+                break;
+            }
+            case 3:
+                setPair(rp, pair(rp) + ((y & 1) ? -1 : 1));  // INX/DCX
+                cycles += t(6, 5);
+                break;
+            case 4:
+            case 5: {
+                uint8_t v = reg(y) + (z == 4 ? 1 : -1);  // INR/DCR
+                setReg(y, v);
+                f = (f & (AC | CY)) | szp(v);
+                cycles += y == M ? 10 : t(4, 5);
+                break;
+            }
+            case 6:
+                setReg(y, fetch());  // MVI
+                cycles += y == M ? 10 : 7;
+                break;
+            case 7: {
+                uint8_t a = r[A];
+                switch (y) {
+                    case 0: r[A] = (a << 1) | (a >> 7); setCarry(a & 0x80); break;           // RLC
+                    case 1: r[A] = (a >> 1) | (a << 7); setCarry(a & 0x01); break;           // RRC
+                    case 2: r[A] = (a << 1) | (f & CY); setCarry(a & 0x80); break;           // RAL
+                    case 3: r[A] = (a >> 1) | ((f & CY) << 7); setCarry(a & 0x01); break;    // RAR
+                    case 4: {                                                                // DAA
+                        // Intel's two steps: fix the low digit, then the high
+                        // digit of the result so far, carry included
+                        bool carry = f & CY;
+                        int v = a;
+                        if ((a & 0x0F) > 9 || (f & AC)) v += 0x06;
+                        if ((v >> 4) > 9 || carry) {
+                            v += 0x60;
+                            carry = true;
+                        }
+                        r[A] = v & 0xFF;
+                        f = (f & AC) | szp(r[A]) | (carry ? CY : 0);
+                        break;
+                    }
+                    case 5: r[A] = ~a; break;          // CMA
+                    case 6: setCarry(true); break;     // STC
+                    case 7: f ^= CY; break;            // CMC
+                }
+                cycles += 4;
+                break;
+            }
+        }
+    }
+
+    void group3(uint8_t op, int y, int z) {
+        int rp = y >> 1;
+        switch (z) {
+            case 0:  // Rcc
+                if (condition(y)) {
+                    pc = pop();
+                    cycles += t(12, 11);
+                } else {
+                    cycles += t(6, 5);
+                }
+                break;
+            case 1:
+                if (!(y & 1)) {  // POP
+                    uint16_t v = pop();
+                    if (rp == 3) {
+                        r[A] = v >> 8;
+                        f = v & (S | Z | AC | P | CY);
+                    } else {
+                        setPair(rp, v);
+                    }
+                    cycles += 10;
+                } else if (y == 1) {  // RET
+                    pc = pop();
+                    cycles += 10;
+                } else if (y == 5) {  // PCHL
+                    pc = hl();
+                    cycles += t(6, 5);
+                } else if (y == 7) {  // SPHL
+                    sp = hl();
+                    cycles += t(6, 5);
+                } else if (i8085) {   // 0xD9: undefined on the 8085
+                    cycles += 4;
+                } else {              // 0xD9: RET on the 8080
+                    pc = pop();
+                    cycles += 10;
+                }
+                break;
+            case 2: {  // Jcc
+                uint16_t target = fetch16();
+                if (condition(y)) {
+                    pc = target;
+                    cycles += 10;
+                } else {
+                    cycles += t(7, 10);
+                }
+                break;
+            }
+            case 3:
+                switch (y) {
+                    case 0: pc = fetch16(); cycles += 10; break;  // JMP
+                    case 2: {                                     // OUT
+                        uint8_t port = fetch();
+                        if (banked && port == BANK_PORT) bank = r[A] & 0x07;
+                        else io->write(port, r[A]);
+                        cycles += 10;
+                        break;
+                    }
+                    case 3: r[A] = io->read(fetch()); cycles += 10; break;  // IN
+                    case 4: {                                               // XTHL
+                        uint8_t low = read(sp), high = read(sp + 1);
+                        write(sp, r[L]);
+                        write(sp + 1, r[H]);
+                        r[L] = low;
+                        r[H] = high;
+                        cycles += t(16, 18);
+                        break;
+                    }
+                    case 5: std::swap(r[D], r[H]); std::swap(r[E], r[L]); cycles += 4; break;  // XCHG
+                    case 6: ie = false; cycles += 4; break;  // DI
+                    case 7: ie = true; cycles += 4; break;   // EI
+                    default:                                 // 0xCB: undefined on the 8085, JMP on the 8080
+                        if (i8085) {
+                            cycles += 4;
+                        } else {
+                            pc = fetch16();
+                            cycles += 10;
+                        }
+                        break;
+                }
+                break;
+            case 4: {  // Ccc
+                uint16_t target = fetch16();
+                if (condition(y)) {
+                    push(pc);
+                    pc = target;
+                    cycles += t(18, 17);
+                } else {
+                    cycles += t(9, 11);
+                }
+                break;
+            }
+            case 5:
+                if (!(y & 1)) {  // PUSH
+                    push(rp == 3 ? (r[A] << 8) | f | 0x02 : pair(rp));
+                    cycles += t(12, 11);
+                } else if (y == 1 || !i8085) {  // CALL; 0xDD, 0xED, 0xFD on the 8080
+                    uint16_t target = fetch16();
+                    push(pc);
+                    pc = target;
+                    cycles += t(18, 17);
+                } else {              // 0xDD, 0xED, 0xFD undefined on the 8085
+                    cycles += 4;
+                }
+                break;
+            case 6:
+                alu(y, fetch());
+                cycles += 7;
+                break;
+            case 7:  // RST
+                push(pc);
+                pc = op & 0x38;
+                cycles += t(12, 11);
+                break;
+        }
+    }
+};
+
+// One fuzz case: a memory image, a program overlaid on it, and registers
+struct Case {
+    uint64_t pattern = 0;   // Seed the banks are filled from; 0 for all zeros
+    uint16_t pc = 0;
+    uint16_t sp = 0;
+    uint8_t regs[8] = {};   // A, flags, B, C, D, E, H, L
+    bool ie = false;
+    uint32_t steps = 0;
+    std::vector<uint8_t> program;
+
+    std::string encode() const {
+        std::ostringstream oss;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%" PRIx64 ":%04X:%04X:", pattern, pc, sp);
+        oss << buf;
+        for (uint8_t v : regs) {
+            snprintf(buf, sizeof(buf), "%02X", v);
+            oss << buf;
+        }
+        oss << ":" << (ie ? 1 : 0) << ":" << steps << ":";
+        for (uint8_t v : program) {
+            snprintf(buf, sizeof(buf), "%02X", v);
+            oss << buf;
+        }
+        return oss.str();
+    }
+
+    bool decode(const char* text) {
+        unsigned pcValue, spValue, ieValue;
+        char regText[17], programText[1024] = "";
+        int read = sscanf(text, "%" SCNx64 ":%x:%x:%16[0-9A-Fa-f]:%u:%u:%1023[0-9A-Fa-f]",
+                          &pattern, &pcValue, &spValue, regText, &ieValue, &steps, programText);
+        if (read < 6 || strlen(regText) != 16 || strlen(programText) % 2) return false;
+        pc = pcValue;
+        sp = spValue;
+        ie = ieValue != 0;
+        for (int i = 0; i < 8; i++) regs[i] = strtoul(std::string(regText + i * 2, 2).c_str(), nullptr, 16);
+        program.clear();
+        for (size_t i = 0; programText[i]; i += 2) {
+            program.push_back(strtoul(std::string(programText + i, 2).c_str(), nullptr, 16));
+        }
+        return true;
+    }
+};
+
+// Generates cases. Opcodes are uniform; operands are biased toward the
+// places bugs hide: branch targets inside the program, the bank port,
+// and addresses at the top of memory.
+Case generateCase(uint64_t& rng, uint64_t pattern, uint64_t index, uint32_t steps) {
+    Case c;
+    c.pattern = pattern;
+    c.steps = steps;
+    uint64_t bits = splitmix(rng);
+    // Rotate programs over 128 pages so no page hits the JIT's SMC limit
+    // between restarts; now and then put one anywhere, wrap-around included
+    c.pc = (bits & 0x0F) ? (uint16_t)(((0x10 + index % 128) << 8) | ((bits >> 8) & 0xFF))
+                         : (uint16_t)(bits >> 16);
+    c.sp = (bits >> 32) & 1 ? (uint16_t)(bits >> 40) : (uint16_t)(c.pc - 0x40 - ((bits >> 48) & 0x3F));
+    uint64_t regBits = splitmix(rng);
+    for (int i = 0; i < 8; i++) c.regs[i] = (regBits >> (i * 8)) & 0xFF;
+    c.ie = (bits >> 33) & 1;
+
+    int count = 1 + splitmix(rng) % 24;
+    for (int i = 0; i < count; i++) {
+        uint64_t r = splitmix(rng);
+        uint8_t op = r & 0xFF;
+        c.program.push_back(op);
+        int length = opcodeLength(op);
+        if (length == 1) continue;
+        if (op == 0xD3 || op == 0xDB) {
+            c.program.push_back(((r >> 8) & 3) == 0 ? BANK_PORT : (r >> 16) & 0xFF);
+        } else if (length == 2) {
+            c.program.push_back((r >> 8) & 0xFF);
+        } else {
+            uint16_t operand = (r >> 16) & 0xFFFF;
+            bool branch = op == 0xC3 || op == 0xCD || (op & 0xC7) == 0xC2 || (op & 0xC7) == 0xC4;
+            if (branch && ((r >> 8) & 1)) operand = c.pc + (r >> 32) % (count * 3);
+            else if (((r >> 8) & 7) == 1) operand = 0xFFFF;
+            c.program.push_back(operand & 0xFF);
+            c.program.push_back(operand >> 8);
+        }
+    }
+    return c;
+}
+
+// Runs cases on the core and the reference and reports differences.
+// Only the cores in the mask are built; JIT cores each map a code arena.
+class Harness {
+public:
+    explicit Harness(uint32_t cores = ALL_CORES) : loaded_pattern(0) {
+        for (int core = 0; core < NUM_CORES; core++) {
+            dirty[core] = false;
+            since_restart[core] = 0;
+            if (!(cores & (1u << core))) continue;
+            withSlot(core, [this, core](auto& slot) {
+                slot.reset(new typename std::decay_t<decltype(slot)>::element_type());
+                slot->setIOCallbacks(
+                    [this](uint8_t port) { return core_io.read(port); },
+                    [this](uint8_t port, uint8_t value) { core_io.write(port, value); });
+                restartJIT(*slot, core);
+            });
+        }
+        ref.io = &ref_io;
+    }
+
+    // Returns false, with a description in report, on divergence
+    bool run(const Case& c, int core, std::string* report) {
+        ref.i8085 = core != CORE_I8080 && core != CORE_I8080_JIT;
+        ref.banked = core <= CORE_THREADED;
+        bool result = true;
+        withCore(core, [&](auto& cpu) { result = runOn(cpu, core, c, report); });
+        return result;
+    }
+
+private:
+    std::unique_ptr<CPU8085> cpu8085[CORE_THREADED + 1];
+    std::unique_ptr<FlatCPU8085> flat;
+    std::unique_ptr<CPU8080> cpu8080[2];
+    RefCPU ref;
+    IOTrace core_io;
+    IOTrace ref_io;
+    std::vector<uint8_t> pattern_image = std::vector<uint8_t>(NUM_BANKS * BANK_SIZE);
+    uint64_t loaded_pattern;
+    bool dirty[NUM_CORES];
+    uint32_t since_restart[NUM_CORES];
+
+    // Call fn with the pointer holding the core's CPU, whatever its configuration
+    template<class Fn>
+    void withSlot(int core, Fn fn) {
+        switch (core) {
+            case CORE_FLAT: fn(flat); break;
+            case CORE_I8080: case CORE_I8080_JIT: fn(cpu8080[core - CORE_I8080]); break;
+            default: fn(cpu8085[core]); break;
+        }
+    }
+
+    // Call fn with the core's CPU; the core must be one the harness built
+    template<class Fn>
+    void withCore(int core, Fn fn) {
+        withSlot(core, [&fn](auto& slot) { fn(*slot); });
+    }
+
+    static bool usesJIT(int core) {
+        return core == CORE_JIT || core == CORE_THREADED || core == CORE_I8080_JIT;
+    }
+
+    template<class CPU>
+    void restartJIT(CPU& cpu, int core) {
+        cpu.setJITEnabled(false);
+        if (!usesJIT(core)) return;
+        cpu.setJITEnabled(true);
+        cpu.getJIT()->setHotThreshold(1);
+        cpu.getJIT()->setNativeEnabled(core != CORE_THREADED);
+    }
+
+    template<class CPU>
+    bool runOn(CPU& cpu, int core, const Case& c, std::string* report) {
+        bool& cpuDirty = dirty[core];
+        if (usesJIT(core) && ++since_restart[core] >= JIT_RESTART_CASES) {
+            restartJIT(cpu, core);
+            since_restart[core] = 0;
+        }
+        loadPattern(c.pattern);
+        if (cpuDirty) {
+            for (int bank = 0; bank < CPU::NUM_BANKS; bank++) {
+                cpu.copyIntoBank(bank, 0, &pattern_image[bank * BANK_SIZE], BANK_SIZE);
+            }
+            cpuDirty = false;
+        }
+
+        // Same starting point for both
+        for (size_t i = 0; i < c.program.size(); i++) {
+            uint16_t address = c.pc + i;
+            cpu.setMemoryInBank(0, address, c.program[i]);
+            ref.memory[address] = c.program[i];
+        }
+        cpu.A = ref.r[RefCPU::A] = c.regs[0];
+        cpu.setFlags(c.regs[1]);
+        ref.f = c.regs[1] & CPU::FLAG_ALL;
+        cpu.B = ref.r[RefCPU::B] = c.regs[2];
+        cpu.C = ref.r[RefCPU::C] = c.regs[3];
+        cpu.D = ref.r[RefCPU::D] = c.regs[4];
+        cpu.E = ref.r[RefCPU::E] = c.regs[5];
+        cpu.H = ref.r[RefCPU::H] = c.regs[6];
+        cpu.L = ref.r[RefCPU::L] = c.regs[7];
+        cpu.SP = ref.sp = c.sp;
+        cpu.PC = ref.pc = c.pc;
+        cpu.interruptEnabled = ref.ie = c.ie;
+        cpu.interruptPending = false;
+        cpu.halted = ref.halted = false;
+        cpu.current_bank = ref.bank = 0;
+        core_io.clear();
+        ref_io.clear();
+        uint64_t cycles = cpu.metrics.cycles;
+        uint64_t instructions = cpu.metrics.instructions;
+        ref.cycles = ref.instructions = 0;
+
+        // run() stops early on HLT; the reference follows whatever the
+        // core actually retired
+        uint64_t done = cpu.run(c.steps);
+        uint64_t refDone = ref.run(done);
+
+        std::ostringstream diff;
+        char buf[128];
+        auto check = [&](const char* name, uint64_t got, uint64_t want, int width) {
+            if (got == want) return;
+            snprintf(buf, sizeof(buf), "  %-13s core %0*" PRIX64 ", reference %0*" PRIX64 "\n",
+                     name, width, got, width, want);
+            diff << buf;
+        };
+        check("steps", done, refDone, 1);
+        if (done > c.steps) {
+            snprintf(buf, sizeof(buf), "  steps         core ran %" PRIu64 " of a %" PRIu64 " budget\n",
+                     done, (uint64_t)c.steps);
+            diff << buf;
+        }
+        check("instructions", cpu.metrics.instructions - instructions, ref.instructions, 1);
+        check("cycles", cpu.metrics.cycles - cycles, ref.cycles, 1);
+        check("A", cpu.A, ref.r[RefCPU::A], 2);
+        check("flags", cpu.getFlags(), ref.f | CPU::PSW_ONE, 2);
+        check("B", cpu.B, ref.r[RefCPU::B], 2);
+        check("C", cpu.C, ref.r[RefCPU::C], 2);
+        check("D", cpu.D, ref.r[RefCPU::D], 2);
+        check("E", cpu.E, ref.r[RefCPU::E], 2);
+        check("H", cpu.H, ref.r[RefCPU::H], 2);
+        check("L", cpu.L, ref.r[RefCPU::L], 2);
+        check("SP", cpu.SP, ref.sp, 4);
+        check("PC", cpu.PC, ref.pc, 4);
+        check("halted", cpu.halted, ref.halted, 1);
+        check("interrupts", cpu.interruptEnabled, ref.ie, 1);
+        check("bank", cpu.current_bank, ref.bank, 1);
+        check("port reads", core_io.reads, ref_io.reads, 1);
+        if (core_io.writes != ref_io.writes) {
+            snprintf(buf, sizeof(buf), "  port writes   core %zu, reference %zu (or different values)\n",
+                     core_io.writes.size(), ref_io.writes.size());
+            diff << buf;
+        }
+        // Any bank the guest could have stored into, in full
+        for (int bank = 0; bank < CPU::NUM_BANKS; bank++) {
+            if (bank != 0 && bank != cpu.current_bank && !touched(bank)) continue;
+            const uint8_t* got = cpu.memory_banks[bank];
+            const uint8_t* want = &ref.memory[bank * BANK_SIZE];
+            if (!memcmp(got, want, BANK_SIZE)) continue;
+            size_t at = 0;
+            while (got[at] == want[at]) at++;
+            snprintf(buf, sizeof(buf), "  memory        bank %d at %04zX: core %02X, reference %02X\n",
+                     bank, at, got[at], want[at]);
+            diff << buf;
+        }
+
+        // Undo the case: stores the reference made, then the program
+        bool diverged = !diff.str().empty();
+        for (size_t i = ref.undo.size(); i-- > 0;) {
+            uint32_t at = ref.undo[i].first;
+            if (!diverged) cpu.setMemoryInBank(at / BANK_SIZE, at % BANK_SIZE, pattern_image[at]);
+        }
+        ref.rollback();
+        for (size_t i = 0; i < c.program.size(); i++) {
+            uint16_t address = c.pc + i;
+            if (!diverged) cpu.setMemoryInBank(0, address, pattern_image[address]);
+            ref.memory[address] = pattern_image[address];
+        }
+        if (diverged) {
+            cpuDirty = true;
+            if (report) *report = diff.str();
+        }
+        return !diverged;
+    }
+
+    bool touched(int bank) const {
+        for (const auto& store : ref.undo) {
+            if ((int)(store.first / BANK_SIZE) == bank) return true;
+        }
+        return false;
+    }
+
+    void loadPattern(uint64_t pattern) {
+        if (pattern == loaded_pattern) return;
+        uint64_t state = pattern;
+        for (size_t i = 0; i < pattern_image.size(); i += 8) {
+            uint64_t v = pattern ? splitmix(state) : 0;
+            memcpy(&pattern_image[i], &v, 8);
+        }
+        ref.memory = pattern_image;
+        std::fill(dirty, dirty + NUM_CORES, true);
+        loaded_pattern = pattern;
+    }
+};
+
+bool fails(const Case& c, int core) {
+    Harness harness(1u << core);
+    return !harness.run(c, core, nullptr);
+}
+
+// Greedy shrinking: keep any simplification that still diverges
+Case minimize(Case c, int core) {
+    for (uint32_t steps = 1; steps < c.steps; steps++) {
+        Case t = c;
+        t.steps = steps;
+        if (fails(t, core)) {
+            c = t;
+            break;
+        }
+    }
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        auto attempt = [&](const Case& t) {
+            if (!fails(t, core)) return false;
+            c = t;
+            progress = true;
+            return true;
+        };
+        while (c.program.size() > 1) {
+            Case t = c;
+            t.program.pop_back();
+            if (!attempt(t)) break;
+        }
+        for (size_t i = 0; i < c.program.size(); i++) {
+            if (!c.program[i]) continue;
+            Case t = c;
+            t.program[i] = 0;
+            attempt(t);
+        }
+        for (int i = 0; i < 8; i++) {
+            if (!c.regs[i]) continue;
+            Case t = c;
+            t.regs[i] = 0;
+            attempt(t);
+        }
+        if (c.ie) {
+            Case t = c;
+            t.ie = false;
+            attempt(t);
+        }
+        if (c.pattern) {
+            Case t = c;
+            t.pattern = 0;
+            attempt(t);
+        }
+    }
+    return c;
+}
+
+struct Shared {
+    std::atomic<uint64_t> cases{0};
+    std::atomic<uint64_t> executions{0};
+    std::atomic<bool> stop{false};
+    std::mutex mutex;
+    bool found = false;
+    Case failure;
+    int failure_core = CORE_INTERP;
+};
+
+void worker(Shared& shared, uint64_t seed, uint64_t maxCases, uint32_t steps, const bool* cores) {
+    uint32_t built = 0;
+    for (int core = 0; core < NUM_CORES; core++) {
+        if (cores[core]) built |= 1u << core;
+    }
+    Harness harness(built);
+    uint64_t rng = seed;
+    uint64_t pattern = splitmix(rng) | 1;
+    for (uint64_t index = 0; !shared.stop.load(std::memory_order_relaxed); index++) {
+        if (maxCases && shared.cases.fetch_add(1, std::memory_order_relaxed) >= maxCases) break;
+        if (!maxCases) shared.cases.fetch_add(1, std::memory_order_relaxed);
+
+        Case c = generateCase(rng, pattern, index, steps);
+        for (int core = 0; core < NUM_CORES; core++) {
+            if (!cores[core]) continue;
+            shared.executions.fetch_add(1, std::memory_order_relaxed);
+            if (harness.run(c, core, nullptr)) continue;
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            if (!shared.found) {
+                shared.found = true;
+                shared.failure = c;
+                shared.failure_core = core;
+            }
+            shared.stop = true;
+            return;
+        }
+    }
+}
+
+int replay(const Case& c, const bool* cores) {
+    int status = 0;
+    for (int core = 0; core < NUM_CORES; core++) {
+        if (!cores[core]) continue;
+        Harness harness(1u << core);
+        std::string report;
+        if (harness.run(c, core, &report)) {
+            printf("%s: matches the reference\n", kCoreNames[core]);
+        } else {
+            printf("%s: diverges from the reference\n%s", kCoreNames[core], report.c_str());
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// Parse a --core list into cores; false on an unknown name
+bool parseCores(const char* list, bool* cores) {
+    std::fill(cores, cores + NUM_CORES, false);
+    std::stringstream names(list);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        if (name == "all") {
+            std::fill(cores, cores + NUM_CORES, true);
+        } else if (name == "both") {
+            cores[CORE_INTERP] = cores[CORE_JIT] = true;
+        } else {
+            const char* const* found = std::find(kCoreNames, kCoreNames + NUM_CORES, name);
+            if (found == kCoreNames + NUM_CORES) return false;
+            cores[found - kCoreNames] = true;
+        }
+    }
+    return std::find(cores, cores + NUM_CORES, true) != cores + NUM_CORES;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    double seconds = 10.0;
+    uint64_t maxCases = 0;
+    uint64_t seed = std::chrono::steady_clock::now().time_since_epoch().count();
+    uint32_t steps = 64;
+    bool cores[NUM_CORES];
+    std::fill(cores, cores + NUM_CORES, true);
+    const char* replayCase = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--threads") && hasValue) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--seconds") && hasValue) {
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--cases") && hasValue) {
+            maxCases = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--seed") && hasValue) {
+            seed = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--steps") && hasValue) {
+            steps = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--core") && hasValue) {
+            const char* list = argv[++i];
+            if (!parseCores(list, cores)) {
+                fprintf(stderr, "Cores must be a comma-separated list of interp, jit, threaded, flat, "
+                                "i8080 and i8080-jit, or all, got %s\n", list);
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--replay") && hasValue) {
+            replayCase = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (replayCase) {
+        Case c;
+        if (!c.decode(replayCase)) {
+            fprintf(stderr, "Could not parse case %s\n", replayCase);
+            return 2;
+        }
+        return replay(c, cores);
+    }
+
+    std::string coreList;
+    for (int core = 0; core < NUM_CORES; core++) {
+        if (!cores[core]) continue;
+        if (!coreList.empty()) coreList += ",";
+        coreList += kCoreNames[core];
+    }
+    printf("Fuzzing %s with %u threads, seed %" PRIu64 ", %u steps per case\n",
+           coreList.c_str(), threads, seed, steps);
+
+    Shared shared;
+    std::vector<std::thread> pool;
+    uint64_t seeder = seed;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back(worker, std::ref(shared), splitmix(seeder), maxCases, steps, cores);
+    }
+
+    // Progress once a second until time runs out, the cases are done or a
+    // worker finds a divergence
+    uint64_t lastExecutions = 0;
+    auto last = start;
+    auto deadline = start + std::chrono::duration<double>(seconds);
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto now = std::chrono::steady_clock::now();
+        bool done = shared.stop || (maxCases && shared.cases >= maxCases) || (!maxCases && now >= deadline);
+        if (done) break;
+        if (now - last >= std::chrono::seconds(1)) {
+            uint64_t executions = shared.executions;
+            double elapsed = std::chrono::duration<double>(now - last).count();
+            fprintf(stderr, "  %" PRIu64 " cases, %.0f executions/s\n",
+                    (uint64_t)shared.cases, (executions - lastExecutions) / elapsed);
+            lastExecutions = executions;
+            last = now;
+        }
+    }
+    shared.stop = true;
+    for (std::thread& t : pool) t.join();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t executions = shared.executions;
+    printf("%" PRIu64 " executions in %.1f s: %.0f executions/s (%.0f per thread)\n",
+           executions, elapsed, executions / elapsed, executions / elapsed / threads);
+
+    if (!shared.found) {
+        printf("No divergence from the reference\n");
+        return 0;
+    }
+
+    const char* core = kCoreNames[shared.failure_core];
+    printf("\n%s diverged from the reference on case:\n  %s\n", core, shared.failure.encode().c_str());
+    if (!fails(shared.failure, shared.failure_core)) {
+        printf("It does not reproduce on a fresh core; state left over from earlier cases is involved\n");
+        return 1;
+    }
+    Case small = minimize(shared.failure, shared.failure_core);
+    std::string report;
+    Harness harness(1u << shared.failure_core);
+    harness.run(small, shared.failure_core, &report);
+    printf("Minimized (%zu program bytes, %u steps):\n  %s\n%s", small.program.size(), small.steps,
+           small.encode().c_str(), report.c_str());
+    printf("Replay with: cpufuzz --core %s --replay %s\n", core, small.encode().c_str());
+    return 1;
+}
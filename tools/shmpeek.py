@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""
+Read guest state from a running emulator started with --shm
+Prints the registers and optionally dumps memory, without pausing the guest
+"""
+
+import mmap
+import struct
+import sys
+
+# Status block layout, see sharedstate.h
+STATUS = struct.Struct('<8sIIIIII8BHHBBBBHHIQQQ')
+FLAG_NAMES = [(0x80, 'S'), (0x40, 'Z'), (0x10, 'AC'), (0x04, 'P'), (0x01, 'CY')]
+
+
+def read_status(view):
+    # Sequence lock: retry while the emulator is mid-update
+    while True:
+        before = struct.unpack_from('<I', view, 0x18)[0]
+        if before & 1:
+            continue
+        fields = STATUS.unpack_from(view, 0)
+        if struct.unpack_from('<I', view, 0x18)[0] == before:
+            return fields
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: shmpeek.py </dev/shm/NAME or /proc/PID/fd/N> [BANK:ADDR[:LEN]]")
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as f:
+        view = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+
+    (magic, version, header_size, bank_count, bank_size, sequence, pid,
+     a, flags, b, c, d, e, h, l, sp, pc, bank, halted, ie, pending, vector,
+     _, _, instructions, cycles, publishes) = read_status(view)
+    if magic != b'8085SHM\0' or version != 1:
+        print(f"Error: {sys.argv[1]} is not an 8085 shared state object")
+        sys.exit(1)
+
+    set_flags = ' '.join(name for bit, name in FLAG_NAMES if flags & bit) or '-'
+    print(f"PID {pid}, {bank_count} banks, update {publishes}")
+    print(f"A={a:02X} B={b:02X} C={c:02X} D={d:02X} E={e:02X} H={h:02X} L={l:02X} "
+          f"SP={sp:04X} PC={pc:04X} Flags={flags:02X} [{set_flags}]")
+    print(f"Bank {bank}, {'halted' if halted else 'running'}, interrupts {'on' if ie else 'off'}"
+          + (f", RST {vector:04X} pending" if pending else ""))
+    print(f"{instructions} instructions, {cycles} cycles")
+
+    if len(sys.argv) > 2:
+        parts = sys.argv[2].split(':')
+        dump_bank = int(parts[0], 0)
+        addr = int(parts[1], 16)
+        length = int(parts[2], 0) if len(parts) > 2 else 128
+        if dump_bank >= bank_count or addr + length > bank_size:
+            print("Error: dump range outside guest memory")
+            sys.exit(1)
+        start = header_size + dump_bank * bank_size + addr
+        data = view[start:start + length]
+        for offset in range(0, length, 16):
+            row = data[offset:offset + 16]
+            text = ''.join(chr(x) if 0x20 <= x < 0x7F else '.' for x in row)
+            print(f"{addr + offset:04X}: {' '.join(f'{x:02X}' for x in row):<47}  {text}")
+
+
+if __name__ == '__main__':
+    main()